@@ -0,0 +1,47 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "neotrellis.h"
+
+// Host-streamed framebuffer over the USB CDC port.
+//
+// Packet: A5 <type> <seq> <len> <payload[len]> <check>
+//   check = XOR of type, seq, len and every payload byte
+//
+//   FBS_FRAME  payload = 48 bytes, GRB per key (the NeoPixel wire order)
+//   FBS_DELTA  payload = <offset> <bytes...>, patched over the last frame
+//   FBS_RATE   payload = <fps>, 0 = present as fast as the bus allows
+//   FBS_STATS  no payload; answered with FBS_STATS_REPLY carrying
+//              fbstream_stats_t as little-endian u32s
+//
+// Received frames go into one half of a double buffer while the other half
+// is uploaded to the seesaw one chunk per fbstream_task() call, so the CDC
+// FIFO keeps draining between I2C transfers.
+
+#define FBS_SYNC           0xA5
+#define FBS_FRAME          0x01
+#define FBS_DELTA          0x02
+#define FBS_RATE           0x03
+#define FBS_STATS          0x04
+#define FBS_STATS_REPLY    0x84
+
+#define FBS_MAX_PAYLOAD    (NEOTRELLIS_BYTES + 1)
+
+#ifndef FBS_IDLE_TIMEOUT_MS
+#define FBS_IDLE_TIMEOUT_MS  500   // key presses own the LEDs again after this
+#endif
+
+typedef struct {
+    uint32_t received;     // complete, valid frames (full or delta)
+    uint32_t shown;        // frames latched on the LEDs
+    uint32_t dropped;      // replaced by a newer frame before upload started
+    uint32_t late;         // shown more than one frame period after arrival
+    uint32_t bad_packets;  // checksum/length errors
+    uint32_t seq_gaps;     // missing sequence numbers seen on the wire
+} fbstream_stats_t;
+
+void fbstream_init(void);
+void fbstream_task(void);           // call every main-loop pass
+bool fbstream_active(void);         // host has sent a frame recently
+void fbstream_get_stats(fbstream_stats_t *out);
+void fbstream_print_stats(void);
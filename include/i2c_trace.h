@@ -0,0 +1,44 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Seesaw bus trace. seesaw_write/seesaw_write_buf/seesaw_read log every
+// transaction into a RAM ring; i2c_trace_dump() prints it as CSV so it can
+// be fed to tools/i2c_replay. Build with -D SEESAW_TRACE=0 to drop the hook.
+#ifndef SEESAW_TRACE
+#define SEESAW_TRACE 1
+#endif
+
+#ifndef I2C_TRACE_DEPTH
+#define I2C_TRACE_DEPTH 256            // power of two
+#endif
+
+#define I2C_TRACE_WRITE      'W'       // seesaw_write
+#define I2C_TRACE_WRITE_BUF  'B'       // seesaw_write_buf
+#define I2C_TRACE_READ       'R'       // seesaw_read
+
+typedef struct {
+    uint32_t t_us;      // start, low 32 bits of time since boot
+    uint16_t dur_us;    // saturates at 65535
+    uint8_t  dir;       // I2C_TRACE_*
+    uint8_t  addr;
+    uint8_t  module;
+    uint8_t  reg;
+    uint16_t len;       // payload bytes, excluding the module/reg header
+    uint16_t digest;    // CRC-16/CCITT of the payload
+    uint8_t  ok;
+    uint8_t  _pad;
+} i2c_trace_rec_t;
+
+#if SEESAW_TRACE
+void     i2c_trace_record(uint8_t dir, uint8_t addr, uint8_t module, uint8_t reg,
+                          const uint8_t *data, uint16_t len, bool ok,
+                          uint32_t t_start_us, uint32_t t_end_us);
+#endif
+void     i2c_trace_enable(bool on);
+bool     i2c_trace_enabled(void);
+void     i2c_trace_clear(void);
+uint32_t i2c_trace_count(void);        // records currently held
+void     i2c_trace_dump(void);
+uint16_t i2c_trace_digest(const uint8_t *data, size_t len);
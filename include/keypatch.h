@@ -0,0 +1,43 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "neotrellis.h"
+
+// Per-key patch table: one entry per key holds everything the event path
+// needs, so dispatch is a single indexed load instead of an if-chain.
+#define KEYPATCH_KEYS        NEOTRELLIS_LED_COUNT
+#define KEYPATCH_BANKS       4
+#define KEYPATCH_LABEL_LEN   27
+
+#define KP_NOTE_NONE         0xFF   // no voice for this key
+
+// Behaviour flags
+#define KP_FLAG_MUTE         0x01   // light only, never touches the voice
+#define KP_FLAG_DARK         0x02   // sound only, LED stays off
+#define KP_FLAG_LATCH        0x04   // press toggles on/off, release is ignored
+
+typedef struct {
+    uint8_t r, g, b;
+    uint8_t note;                        // MIDI note number or KP_NOTE_NONE
+    uint8_t flags;                       // KP_FLAG_*
+    char    label[KEYPATCH_LABEL_LEN];   // shown in the key log
+} key_patch_t;                           // 32 bytes
+
+typedef struct {
+    key_patch_t keys[KEYPATCH_KEYS];
+} key_bank_t;
+
+void               keypatch_init(void);          // flash if valid, else defaults
+void               keypatch_load_defaults(void);
+bool               keypatch_select_bank(uint8_t bank);
+uint8_t            keypatch_active_bank(void);
+const key_patch_t *keypatch_get(int idx);        // from the active bank
+const key_patch_t *keypatch_get_bank(uint8_t bank, int idx);
+bool               keypatch_set(uint8_t bank, int idx, const key_patch_t *patch);
+int                keypatch_find_note(uint8_t note);   // key in active bank, or -1
+
+// Banks persist in the last flash sector (see KEYPATCH_FLASH_OFFSET).
+// Saving blocks interrupts for the erase, stalling USB and the sequencer
+// alarm; call it from the main loop, never mid-performance.
+bool keypatch_load_flash(void);
+bool keypatch_save_flash(void);
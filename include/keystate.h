@@ -0,0 +1,62 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// Central key-state engine. The whole grid lives in packed bitmasks, so
+// "is key N down", "are all of these down" and "how many are down" are
+// single bitwise ops. Raw edges go in through keystate_feed(); debounced
+// press/release plus chord, long-press and repeat events come out of
+// keystate_pop().
+
+#ifndef KEYSTATE_MAX_KEYS
+#define KEYSTATE_MAX_KEYS       64     // four 4x4 boards
+#endif
+#ifndef KEYSTATE_DEBOUNCE_MS
+#define KEYSTATE_DEBOUNCE_MS    10
+#endif
+#ifndef KEYSTATE_LONG_MS
+#define KEYSTATE_LONG_MS        600
+#endif
+#ifndef KEYSTATE_REPEAT_MS
+#define KEYSTATE_REPEAT_MS      150    // 0 disables repeat
+#endif
+
+#define KEYSTATE_MAX_CHORDS     8
+#define KEYSTATE_QUEUE_LEN      32     // power of two
+
+typedef uint64_t keymask_t;
+_Static_assert(KEYSTATE_MAX_KEYS <= 64, "keymask_t holds at most 64 keys");
+
+#define KEYMASK(k)  ((keymask_t)1 << (k))
+
+typedef enum {
+    KEY_EV_PRESS = 0,
+    KEY_EV_RELEASE,
+    KEY_EV_LONG,        // held for the long-press time, fires once
+    KEY_EV_REPEAT,      // every repeat interval after KEY_EV_LONG
+    KEY_EV_CHORD,       // all keys of a registered chord are down
+} key_event_type_t;
+
+typedef struct {
+    uint8_t  type;      // key_event_type_t
+    uint8_t  key;       // key that completed the chord for KEY_EV_CHORD
+    uint8_t  chord;     // chord id, KEY_EV_CHORD only
+    uint32_t t_ms;
+} key_event_t;
+
+void      keystate_init(void);
+void      keystate_set_debounce(int key, uint16_t ms);   // key < 0: all keys
+void      keystate_set_hold(uint16_t long_ms, uint16_t repeat_ms);
+int       keystate_add_chord(keymask_t mask);            // chord id, or -1
+
+void      keystate_feed(int key, bool down, uint32_t now_ms);
+void      keystate_tick(uint32_t now_ms);                // debounce, long press, repeat
+bool      keystate_pop(key_event_t *ev);
+uint32_t  keystate_overflows(void);
+
+keymask_t keystate_down(void);                           // debounced state
+
+static inline bool keystate_is_down(int key)          { return (keystate_down() >> key) & 1u; }
+static inline bool keystate_all_down(keymask_t mask)  { return (keystate_down() & mask) == mask; }
+static inline bool keystate_any_down(keymask_t mask)  { return (keystate_down() & mask) != 0; }
+static inline int  keystate_count_down(void)          { return __builtin_popcountll(keystate_down()); }
@@ -3,6 +3,7 @@
     #pragma once
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #define NEOTRELLIS_LED_COUNT   16
 #define NEOTRELLIS_BYTES       (NEOTRELLIS_LED_COUNT * 3)
@@ -46,6 +47,18 @@ bool neotrellis_status(uint8_t *hw_id, uint32_t *version);
 bool neopixel_begin(uint8_t internal_pin /* usually 3 */);
 bool neopixel_set_bulk(const uint8_t *rgb48);
 bool neopixel_show(void);
+bool neopixel_latch(void);   // SHOW without the settle delay
+// The seesaw needs this long after SHOW before it takes the next LED write.
+// neopixel_latch() records the deadline; every LED writer checks it.
+#define NEOPIXEL_SETTLE_US     10000
+bool     neopixel_bus_ready(void);
+uint32_t neopixel_latch_count(void);
+uint64_t neopixel_last_latch_us(void);
+// Shared LED shadow: writers stage pixels, neopixel_service() uploads the
+// changed ones one bus transfer per call (call every main-loop pass)
+bool neopixel_stage(int idx, uint8_t r, uint8_t g, uint8_t b);   // false: unchanged
+void neopixel_service(void);
+bool neopixel_buf_write(uint16_t start, const uint8_t *data, size_t len);
 bool neotrellis_wait_ready(uint32_t timeout_ms);
 bool neopixel_set_one_and_show(int index, uint8_t r, uint8_t g, uint8_t b);
 bool neopixel_fill_all_and_show(uint8_t r, uint8_t g, uint8_t b);
@@ -60,12 +73,32 @@ bool neotrellis_read_key_event(uint8_t *raw_key, uint8_t *edge);
 void neotrellis_poll_and_light(void);
 bool neotrellis_keypad_init(void);
 void set_led_for_idx(int idx, bool on);
+void neotrellis_select_bank(uint8_t bank);   // switch key patch bank, drops latches
+int  neotrellis_key_edge(int idx, bool pressed);   // physical edge -> 1 on, 0 off, -1 none
+void neotrellis_key_set_latch(int idx, bool on);
+void neotrellis_key_voice(int idx, bool on);
+void neotrellis_key_led(int idx, bool on);
 void neotrellis_clear_fifo(void);
 bool neotrellis_poll_buttons(int *idx_out);
 // bool neotrellis_poll_buttons(void);
 
-static bool key_is_down[16] = { false };   // our debounced view of each key
 void pwm_audio_init(void);
+void pwm_audio_retune(void);
+void play_note(uint8_t note);     // MIDI note number
+bool stop_note(uint8_t note);     // only if that note is sounding
+void stop_voice(void);
+
+// Who started the note on the (monophonic) voice
+typedef enum {
+    VOICE_FREE = 0,
+    VOICE_LIVE,        // keys, MIDI in, console
+    VOICE_SEQ,         // sequencer alarm IRQ
+} voice_owner_t;
+
+#define VOICE_NOTE_NONE 0xFF   // silent, or a raw pwm_play_tone() tone
+#define VOICE_NOTE_ANY  0xFE   // pwm_voice_off(): whatever that owner plays
+void pwm_voice_on(uint8_t note, voice_owner_t owner);    // IRQ-safe, no logging
+bool pwm_voice_off(uint8_t note, voice_owner_t owner);   // IRQ-safe, no logging
 
 #ifndef DEBUG_KEYS
 #define DEBUG_KEYS 1
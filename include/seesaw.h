@@ -22,6 +22,7 @@
 #endif
 
 void seesaw_bus_init(uint32_t hz);
+uint32_t seesaw_bus_retune(void);   // re-apply the baud after a clk_peri change
 bool seesaw_write(uint8_t addr, uint8_t module, uint8_t reg,
                   const uint8_t *data, uint16_t len);
 bool seesaw_read(uint8_t addr, uint8_t module, uint8_t reg,
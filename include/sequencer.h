@@ -0,0 +1,62 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// Step sequencer / looper driven by a hardware timer alarm.
+//
+// Key events are recorded with their edge timestamp and quantised to ticks
+// (SEQ_PPQN per beat) when the take is closed. Playback runs from the alarm
+// IRQ: each step's voice change is applied at its exact tick time (the IRQ
+// only touches PWM registers and RAM, never the I2C bus). LED changes are
+// staged at the same instant and handed to the shared LED shadow by
+// sequencer_task() from the main loop.
+
+#ifndef SEQ_MAX_STEPS
+#define SEQ_MAX_STEPS       256
+#endif
+#define SEQ_PPQN            96       // ticks per beat
+#define SEQ_BPM_MIN         30
+#define SEQ_BPM_MAX         300
+#define SEQ_BPM_DEFAULT     120
+
+#ifndef SEQ_ALARM_LEAD_US
+#define SEQ_ALARM_LEAD_US   8        // alarm fires early, IRQ spins to the exact tick
+#endif
+
+typedef enum {
+    SEQ_IDLE = 0,
+    SEQ_RECORDING,    // first pass, loop length not known yet
+    SEQ_PLAYING,
+    SEQ_OVERDUB,      // playing and recording on top
+} seq_state_t;
+
+typedef struct {
+    uint32_t fired;         // steps applied by the alarm IRQ
+    uint32_t missed;        // target already passed when the alarm was armed
+    uint32_t jitter_max_us; // worst |actual - target| for a voice change
+    uint32_t jitter_min_us;
+    uint64_t jitter_sum_us;
+    uint32_t led_frames;    // SHOWs carrying sequencer LED changes
+    uint32_t led_lat_max_us;// worst tick-to-latch delay for an LED frame
+    uint64_t led_lat_sum_us;
+} seq_stats_t;
+
+bool        sequencer_init(void);
+void        sequencer_task(void);              // call every main-loop pass
+
+void        sequencer_record(void);            // start a new loop from scratch
+void        sequencer_play(void);              // close the recording / restart playback
+void        sequencer_overdub(bool on);
+void        sequencer_stop(void);              // while recording: closes and keeps the take
+void        sequencer_clear(void);
+seq_state_t sequencer_state(void);
+
+void        sequencer_set_bpm(uint16_t bpm);
+uint16_t    sequencer_bpm(void);
+
+// Feed from the key event path; ignored unless recording or overdubbing
+void        sequencer_record_key(int idx, bool pressed, uint64_t t_us);
+
+void        sequencer_get_stats(seq_stats_t *out);
+void        sequencer_reset_stats(void);
+void        sequencer_print_stats(void);
@@ -0,0 +1,19 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// Runtime system-clock profiles. Switching goes through set_sys_clock_khz()
+// and then re-derives everything that was computed from the old clock
+// (I2C baud, UART baud, PWM tone dividers) from clock_get_hz().
+typedef enum {
+    SYSCLK_LOW_POWER = 0,   //  48 MHz
+    SYSCLK_DEFAULT,         // 150 MHz (RP2350 stock)
+    SYSCLK_OVERCLOCK,       // 200 MHz
+    SYSCLK_PROFILE_COUNT
+} sysclk_profile_t;
+
+void             sysclock_init(void);        // detect the profile the board booted with
+bool             sysclock_set_profile(sysclk_profile_t profile);
+sysclk_profile_t sysclock_get_profile(void); // SYSCLK_PROFILE_COUNT if none matches
+uint32_t         sysclock_profile_khz(sysclk_profile_t profile);
+const char      *sysclock_profile_name(sysclk_profile_t profile);
@@ -0,0 +1,43 @@
+#pragma once
+
+// TinyUSB device configuration. The board enumerates as a composite device:
+// a CDC port carrying the framebuffer stream (fbstream.h) and a
+// class-compliant MIDI interface. The console stays on UART0 (see platformio.ini).
+
+// platformio.ini sets these; the fallbacks cover other SDK builds.
+// TinyUSB's RP2040 port also serves the RP2350.
+#ifndef CFG_TUSB_MCU
+#define CFG_TUSB_MCU             OPT_MCU_RP2040
+#endif
+
+#ifndef CFG_TUSB_OS
+#define CFG_TUSB_OS              OPT_OS_PICO
+#endif
+
+#define CFG_TUSB_RHPORT0_MODE    (OPT_MODE_DEVICE | OPT_MODE_FULL_SPEED)
+#define CFG_TUD_ENABLED          1
+
+#ifndef CFG_TUSB_MEM_SECTION
+#define CFG_TUSB_MEM_SECTION
+#endif
+#ifndef CFG_TUSB_MEM_ALIGN
+#define CFG_TUSB_MEM_ALIGN       __attribute__ ((aligned(4)))
+#endif
+
+#define CFG_TUD_ENDPOINT0_SIZE   64
+
+// Class drivers
+#define CFG_TUD_CDC              1
+#define CFG_TUD_MSC              0
+#define CFG_TUD_HID              0
+#define CFG_TUD_MIDI             1
+#define CFG_TUD_VENDOR           0
+
+// Room for a few full frames so reception keeps up while the bus is busy
+#define CFG_TUD_CDC_RX_BUFSIZE   256
+#define CFG_TUD_CDC_TX_BUFSIZE   64
+#define CFG_TUD_CDC_EP_BUFSIZE   64
+
+// One full-speed bulk packet holds 16 USB-MIDI event packets
+#define CFG_TUD_MIDI_RX_BUFSIZE  64
+#define CFG_TUD_MIDI_TX_BUFSIZE  64
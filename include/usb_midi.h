@@ -0,0 +1,35 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// Class-compliant USB MIDI. Key events are queued with usb_midi_key_event()
+// and go out together in one bulk packet on usb_midi_flush(), which the key
+// path calls once per keypad FIFO drain (before any LED upload).
+
+#ifndef USB_MIDI_CHANNEL
+#define USB_MIDI_CHANNEL    0      // 0..15, i.e. MIDI channel 1
+#endif
+#ifndef USB_MIDI_VELOCITY
+#define USB_MIDI_VELOCITY   100    // keypad has no velocity sensing
+#endif
+
+#define USB_MIDI_BATCH_MAX  16     // events per bulk packet (64 bytes)
+
+// Key patch editing over SysEx (0x7D = non-commercial manufacturer ID).
+// Colour components are 7-bit and doubled on the way in.
+//   F0 7D 01 <bank> <key> <r> <g> <b> <note> <flags> F7   set one key
+//   F0 7D 02 <bank> F7                                   select bank
+//   F0 7D 03 F7                                          save banks to flash
+//   F0 7D 04 F7                                          reload banks from flash
+// e.g. amidi -p hw:1,0,0 -S 'F0 7D 01 00 00 10 00 00 3C 00 F7'
+#define USB_MIDI_SYSEX_ID       0x7D
+#define USB_MIDI_SYSEX_SET_KEY  0x01
+#define USB_MIDI_SYSEX_BANK     0x02
+#define USB_MIDI_SYSEX_SAVE     0x03
+#define USB_MIDI_SYSEX_LOAD     0x04
+
+void usb_midi_init(void);
+void usb_midi_task(void);          // call every main-loop pass
+bool usb_midi_key_event(int idx, bool pressed);
+bool usb_midi_note(uint8_t note, uint8_t velocity, bool on);
+void usb_midi_flush(void);
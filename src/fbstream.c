@@ -0,0 +1,238 @@
+#include "fbstream.h"
+#include "pico/stdlib.h"
+#include "tusb.h"
+#include <string.h>
+#include <stdio.h>
+
+// Upload chunking mirrors neopixel_buf_write(): 28 data bytes per transfer
+#define UPLOAD_CHUNK       28
+#define DEFAULT_LATE_US    33333   // lateness bound when no rate is set
+
+typedef enum { RX_SYNC, RX_TYPE, RX_SEQ, RX_LEN, RX_PAYLOAD, RX_CHECK } rx_state_t;
+
+typedef enum { UP_IDLE, UP_DATA, UP_LATCH } up_state_t;
+
+// --- receive side ---
+static rx_state_t rx_state;
+static uint8_t    rx_type, rx_seq, rx_len, rx_pos, rx_check;
+static uint8_t    rx_payload[FBS_MAX_PAYLOAD];
+static bool       seq_valid;
+static uint8_t    last_seq;
+
+// Latest complete picture; deltas are applied here before committing
+static uint8_t staging[NEOTRELLIS_BYTES];
+
+// --- double buffer ---
+static uint8_t  frames[2][NEOTRELLIS_BYTES];
+static uint64_t frame_arrival_us[2];
+static int8_t   pending   = -1;     // committed, waiting for the bus
+static int8_t   uploading = -1;     // being sent to the seesaw
+
+// --- upload side ---
+static up_state_t up_state;
+static uint16_t   up_offset;
+static uint64_t   next_present_us;
+static uint32_t   period_us;        // 0 = unpaced
+static uint64_t   last_frame_us;
+
+static fbstream_stats_t stats;
+
+void fbstream_init(void) {
+    memset(&stats, 0, sizeof(stats));
+    memset(staging, 0, sizeof(staging));
+    rx_state  = RX_SYNC;
+    seq_valid = false;
+    pending   = -1;
+    uploading = -1;
+    up_state  = UP_IDLE;
+    period_us = 0;
+    last_frame_us = 0;
+}
+
+bool fbstream_active(void) {
+    return last_frame_us &&
+           time_us_64() - last_frame_us < (uint64_t)FBS_IDLE_TIMEOUT_MS * 1000u;
+}
+
+void fbstream_get_stats(fbstream_stats_t *out) {
+    if (out) *out = stats;
+}
+
+void fbstream_print_stats(void) {
+    printf("[FBS] rx=%lu shown=%lu dropped=%lu late=%lu bad=%lu gaps=%lu\n",
+           (unsigned long)stats.received, (unsigned long)stats.shown,
+           (unsigned long)stats.dropped, (unsigned long)stats.late,
+           (unsigned long)stats.bad_packets, (unsigned long)stats.seq_gaps);
+}
+
+static void commit_frame(void) {
+    // Never touch the half that is on its way to the seesaw
+    int8_t target;
+    if (uploading >= 0)    target = (int8_t)!uploading;
+    else if (pending >= 0) target = pending;
+    else                   target = 0;
+
+    if (pending >= 0) stats.dropped++;
+
+    memcpy(frames[target], staging, NEOTRELLIS_BYTES);
+    frame_arrival_us[target] = time_us_64();
+    pending = target;
+
+    stats.received++;
+    last_frame_us = frame_arrival_us[target];
+}
+
+static void send_stats_reply(void) {
+    const uint32_t *fields = (const uint32_t *)&stats;
+    const int n_fields = sizeof(stats) / sizeof(uint32_t);
+    uint8_t pkt[4 + sizeof(stats) + 1];
+
+    pkt[0] = FBS_SYNC;
+    pkt[1] = FBS_STATS_REPLY;
+    pkt[2] = rx_seq;
+    pkt[3] = sizeof(stats);
+    for (int i = 0; i < n_fields; i++) {
+        pkt[4 + 4 * i + 0] = (uint8_t)(fields[i]);
+        pkt[4 + 4 * i + 1] = (uint8_t)(fields[i] >> 8);
+        pkt[4 + 4 * i + 2] = (uint8_t)(fields[i] >> 16);
+        pkt[4 + 4 * i + 3] = (uint8_t)(fields[i] >> 24);
+    }
+    uint8_t check = 0;
+    for (size_t i = 1; i < sizeof(pkt) - 1; i++) check ^= pkt[i];
+    pkt[sizeof(pkt) - 1] = check;
+
+    if (tud_cdc_write_available() >= sizeof(pkt)) {
+        tud_cdc_write(pkt, sizeof(pkt));
+        tud_cdc_write_flush();
+    }
+}
+
+static void handle_packet(void) {
+    if (seq_valid && rx_seq != (uint8_t)(last_seq + 1)) {
+        stats.seq_gaps += (uint8_t)(rx_seq - last_seq - 1);
+    }
+    seq_valid = true;
+    last_seq  = rx_seq;
+
+    switch (rx_type) {
+    case FBS_FRAME:
+        if (rx_len != NEOTRELLIS_BYTES) { stats.bad_packets++; return; }
+        memcpy(staging, rx_payload, NEOTRELLIS_BYTES);
+        commit_frame();
+        break;
+
+    case FBS_DELTA: {
+        if (rx_len < 2) { stats.bad_packets++; return; }
+        uint8_t off = rx_payload[0];
+        uint8_t n   = rx_len - 1;
+        if ((unsigned)off + n > NEOTRELLIS_BYTES) { stats.bad_packets++; return; }
+        memcpy(&staging[off], &rx_payload[1], n);
+        commit_frame();
+        break;
+    }
+
+    case FBS_RATE:
+        if (rx_len != 1) { stats.bad_packets++; return; }
+        period_us = rx_payload[0] ? 1000000u / rx_payload[0] : 0;
+        printf("[FBS] rate %u fps\n", rx_payload[0]);
+        break;
+
+    case FBS_STATS:
+        send_stats_reply();
+        break;
+
+    default:
+        stats.bad_packets++;
+        break;
+    }
+}
+
+static void rx_byte(uint8_t b) {
+    switch (rx_state) {
+    case RX_SYNC:
+        if (b == FBS_SYNC) rx_state = RX_TYPE;
+        break;
+    case RX_TYPE:
+        rx_type = b; rx_check = b; rx_state = RX_SEQ;
+        break;
+    case RX_SEQ:
+        rx_seq = b; rx_check ^= b; rx_state = RX_LEN;
+        break;
+    case RX_LEN:
+        if (b > FBS_MAX_PAYLOAD) { stats.bad_packets++; rx_state = RX_SYNC; break; }
+        rx_len = b; rx_check ^= b; rx_pos = 0;
+        rx_state = b ? RX_PAYLOAD : RX_CHECK;
+        break;
+    case RX_PAYLOAD:
+        rx_payload[rx_pos++] = b; rx_check ^= b;
+        if (rx_pos == rx_len) rx_state = RX_CHECK;
+        break;
+    case RX_CHECK:
+        if (b == rx_check) handle_packet();
+        else               stats.bad_packets++;
+        rx_state = RX_SYNC;
+        break;
+    }
+}
+
+static void poll_rx(void) {
+    uint8_t buf[64];
+    while (tud_cdc_available()) {
+        uint32_t n = tud_cdc_read(buf, sizeof(buf));
+        for (uint32_t i = 0; i < n; i++) rx_byte(buf[i]);
+    }
+}
+
+// One bus transfer per call at most, so poll_rx() runs between them
+static void upload_step(void) {
+    // Shared with every other LED writer: waits out their SHOW too
+    if (!neopixel_bus_ready()) return;
+    uint64_t now = time_us_64();
+
+    switch (up_state) {
+    case UP_IDLE:
+        if (pending < 0) return;
+        if (period_us && now < next_present_us) return;
+        uploading = pending;
+        pending   = -1;
+        up_offset = 0;
+        up_state  = UP_DATA;
+        break;
+
+    case UP_DATA: {
+        uint16_t n = NEOTRELLIS_BYTES - up_offset;
+        if (n > UPLOAD_CHUNK) n = UPLOAD_CHUNK;
+        if (!neopixel_buf_write(up_offset, &frames[uploading][up_offset], n)) {
+            // Leave the frame in place and retry the chunk on the next pass
+            return;
+        }
+        up_offset += n;
+        if (up_offset >= NEOTRELLIS_BYTES) up_state = UP_LATCH;
+        break;
+    }
+
+    case UP_LATCH: {
+        if (!neopixel_latch()) return;
+
+        uint64_t shown_at = time_us_64();
+        uint64_t bound = period_us ? period_us : DEFAULT_LATE_US;
+        if (shown_at - frame_arrival_us[uploading] > bound) stats.late++;
+        stats.shown++;
+
+        if (period_us) {
+            // Keep the cadence anchored to the schedule, not to upload jitter
+            next_present_us += period_us;
+            if (next_present_us < shown_at) next_present_us = shown_at + period_us;
+        }
+        uploading = -1;
+        up_state  = UP_IDLE;
+        break;
+    }
+    }
+}
+
+void fbstream_task(void) {
+    poll_rx();
+    upload_step();
+    poll_rx();
+}
@@ -0,0 +1,79 @@
+#include "i2c_trace.h"
+#include <stdio.h>
+
+_Static_assert((I2C_TRACE_DEPTH & (I2C_TRACE_DEPTH - 1)) == 0, "depth must be a power of two");
+
+static i2c_trace_rec_t ring[I2C_TRACE_DEPTH];
+static uint32_t        head;          // total records ever written
+static bool            enabled = SEESAW_TRACE;
+
+uint16_t i2c_trace_digest(const uint8_t *data, size_t len) {
+    uint16_t crc = 0xFFFF;
+    while (len--) {
+        crc ^= (uint16_t)(*data++) << 8;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+#if SEESAW_TRACE
+void i2c_trace_record(uint8_t dir, uint8_t addr, uint8_t module, uint8_t reg,
+                      const uint8_t *data, uint16_t len, bool ok,
+                      uint32_t t_start_us, uint32_t t_end_us) {
+    if (!enabled) return;
+
+    i2c_trace_rec_t *r = &ring[head & (I2C_TRACE_DEPTH - 1)];
+    uint32_t dur = t_end_us - t_start_us;
+
+    r->t_us   = t_start_us;
+    r->dur_us = dur > 0xFFFF ? 0xFFFF : (uint16_t)dur;
+    r->dir    = dir;
+    r->addr   = addr;
+    r->module = module;
+    r->reg    = reg;
+    r->len    = len;
+    r->digest = (data && len) ? i2c_trace_digest(data, len) : 0;
+    r->ok     = ok;
+    head++;
+}
+#endif
+
+void i2c_trace_enable(bool on) {
+    enabled = on;
+}
+
+bool i2c_trace_enabled(void) {
+    return enabled;
+}
+
+void i2c_trace_clear(void) {
+    head = 0;
+}
+
+uint32_t i2c_trace_count(void) {
+    return head < I2C_TRACE_DEPTH ? head : I2C_TRACE_DEPTH;
+}
+
+void i2c_trace_dump(void) {
+    uint32_t n     = i2c_trace_count();
+    uint32_t first = head - n;
+
+    // Pause recording so printing over a bus-driven console can't recurse
+    bool was = enabled;
+    enabled = false;
+
+    printf("# i2c-trace v1 records=%lu overwritten=%lu\n",
+           (unsigned long)n, (unsigned long)(head - n));
+    printf("t_us,dur_us,dir,addr,module,reg,len,ok,digest\n");
+    for (uint32_t i = 0; i < n; i++) {
+        const i2c_trace_rec_t *r = &ring[(first + i) & (I2C_TRACE_DEPTH - 1)];
+        printf("%lu,%u,%c,0x%02X,0x%02X,0x%02X,%u,%u,0x%04X\n",
+               (unsigned long)r->t_us, r->dur_us, r->dir, r->addr,
+               r->module, r->reg, r->len, r->ok, r->digest);
+    }
+    printf("# end\n");
+
+    enabled = was;
+}
@@ -0,0 +1,209 @@
+#include "keypatch.h"
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+#include "pico/flash.h"
+#include <string.h>
+#include <stdio.h>
+
+// Last 4 KB sector of the flash is reserved for key banks
+#ifndef KEYPATCH_FLASH_OFFSET
+#define KEYPATCH_FLASH_OFFSET  (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE)
+#endif
+
+#define KEYPATCH_MAGIC    0x5441504Bu   // "KPAT"
+#define KEYPATCH_VERSION  1
+
+typedef struct {
+    uint32_t   magic;
+    uint16_t   version;
+    uint8_t    bank_count;
+    uint8_t    active;
+    uint32_t   crc;                     // over banks[] only
+    uint32_t   reserved;
+    key_bank_t banks[KEYPATCH_BANKS];
+} keypatch_image_t;
+
+// flash_range_program() takes whole pages
+#define KEYPATCH_IMAGE_SIZE \
+    ((sizeof(keypatch_image_t) + FLASH_PAGE_SIZE - 1) & ~(FLASH_PAGE_SIZE - 1))
+
+_Static_assert(KEYPATCH_IMAGE_SIZE <= FLASH_SECTOR_SIZE, "key banks must fit one sector");
+
+static key_bank_t banks[KEYPATCH_BANKS];
+static uint8_t    active_bank;
+static int8_t     note_to_key[128];   // reverse map for the active bank
+
+// Bank 0 is the original hard-coded layout: chromatic C4..D#5
+static const key_patch_t default_bank0[KEYPATCH_KEYS] = {
+    { 0x20, 0x00, 0x00, 60, 0, "Red"          },
+    { 0x00, 0x20, 0x00, 61, 0, "Green"        },
+    { 0x00, 0x00, 0x20, 62, 0, "Blue"         },
+    { 0x20, 0x20, 0x00, 63, 0, "Yellow"       },
+    { 0x20, 0x00, 0x20, 64, 0, "Magenta"      },
+    { 0x00, 0x20, 0x20, 65, 0, "Cyan"         },
+    { 0x10, 0x10, 0x20, 66, 0, "Bluish"       },
+    { 0x20, 0x10, 0x00, 67, 0, "Orange"       },
+    { 0x10, 0x20, 0x00, 68, 0, "Yellow-Green" },
+    { 0x00, 0x10, 0x20, 69, 0, "Teal"         },
+    { 0x20, 0x00, 0x10, 70, 0, "Pink-Red"     },
+    { 0x10, 0x00, 0x20, 71, 0, "Violet"       },
+    { 0x05, 0x20, 0x05, 72, 0, "Light Green"  },
+    { 0x20, 0x05, 0x05, 73, 0, "Light Red"    },
+    { 0x05, 0x05, 0x20, 74, 0, "Light Blue"   },
+    { 0x20, 0x10, 0x20, 75, 0, "Lavender"     },
+};
+
+static const uint8_t major_notes[KEYPATCH_KEYS] = {
+    60, 62, 64, 65, 67, 69, 71, 72, 74, 76, 77, 79, 81, 83, 84, 86
+};
+static const uint8_t pentatonic_notes[KEYPATCH_KEYS] = {
+    57, 60, 62, 64, 67, 69, 72, 74, 76, 79, 81, 84, 86, 88, 91, 93
+};
+static const uint8_t row_rgb[4][3] = {
+    { 0x20, 0x00, 0x00 }, { 0x20, 0x10, 0x00 }, { 0x00, 0x20, 0x00 }, { 0x00, 0x00, 0x20 }
+};
+
+static void fill_scale_bank(key_bank_t *bank, const uint8_t *scale, const char *name) {
+    for (int i = 0; i < KEYPATCH_KEYS; i++) {
+        key_patch_t *p = &bank->keys[i];
+        p->r = row_rgb[i / 4][0];
+        p->g = row_rgb[i / 4][1];
+        p->b = row_rgb[i / 4][2];
+        p->note  = scale[i];
+        p->flags = 0;
+        snprintf(p->label, sizeof(p->label), "%s %d", name, i);
+    }
+}
+
+static void rebuild_note_map(void) {
+    memset(note_to_key, -1, sizeof(note_to_key));
+    // Lowest key wins when a bank maps one note to several keys
+    for (int i = KEYPATCH_KEYS - 1; i >= 0; i--) {
+        uint8_t note = banks[active_bank].keys[i].note;
+        if (note < 128) note_to_key[note] = (int8_t)i;
+    }
+}
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t len) {
+    crc = ~crc;
+    while (len--) {
+        crc ^= *data++;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+void keypatch_load_defaults(void) {
+    memcpy(banks[0].keys, default_bank0, sizeof(default_bank0));
+    fill_scale_bank(&banks[1], major_notes,      "Major");
+    fill_scale_bank(&banks[2], pentatonic_notes, "Penta");
+
+    // Bank 3: original layout, but keys latch instead of sounding while held
+    memcpy(banks[3].keys, default_bank0, sizeof(default_bank0));
+    for (int i = 0; i < KEYPATCH_KEYS; i++) banks[3].keys[i].flags = KP_FLAG_LATCH;
+    active_bank = 0;
+    rebuild_note_map();
+}
+
+void keypatch_init(void) {
+    if (!keypatch_load_flash()) {
+        keypatch_load_defaults();
+        printf("[KP] no saved banks, using defaults\n");
+    }
+}
+
+bool keypatch_select_bank(uint8_t bank) {
+    if (bank >= KEYPATCH_BANKS) return false;
+    active_bank = bank;
+    rebuild_note_map();
+    printf("[KP] bank %u active\n", bank);
+    return true;
+}
+
+uint8_t keypatch_active_bank(void) {
+    return active_bank;
+}
+
+const key_patch_t *keypatch_get(int idx) {
+    return keypatch_get_bank(active_bank, idx);
+}
+
+const key_patch_t *keypatch_get_bank(uint8_t bank, int idx) {
+    if (bank >= KEYPATCH_BANKS || (unsigned)idx >= KEYPATCH_KEYS) return NULL;
+    return &banks[bank].keys[idx];
+}
+
+bool keypatch_set(uint8_t bank, int idx, const key_patch_t *patch) {
+    if (bank >= KEYPATCH_BANKS || (unsigned)idx >= KEYPATCH_KEYS || !patch) return false;
+    banks[bank].keys[idx] = *patch;
+    banks[bank].keys[idx].label[KEYPATCH_LABEL_LEN - 1] = '\0';
+    if (bank == active_bank) rebuild_note_map();
+    return true;
+}
+
+int keypatch_find_note(uint8_t note) {
+    if (note >= 128) return -1;
+    return note_to_key[note];
+}
+
+bool keypatch_load_flash(void) {
+    const keypatch_image_t *img =
+        (const keypatch_image_t *)(XIP_BASE + KEYPATCH_FLASH_OFFSET);
+
+    if (img->magic != KEYPATCH_MAGIC || img->version != KEYPATCH_VERSION ||
+        img->bank_count != KEYPATCH_BANKS) {
+        return false;
+    }
+    if (crc32_update(0, (const uint8_t *)img->banks, sizeof(img->banks)) != img->crc) {
+        printf("[KP] flash banks CRC mismatch\n");
+        return false;
+    }
+
+    memcpy(banks, img->banks, sizeof(banks));
+    for (int b = 0; b < KEYPATCH_BANKS; b++) {
+        for (int i = 0; i < KEYPATCH_KEYS; i++) {
+            banks[b].keys[i].label[KEYPATCH_LABEL_LEN - 1] = '\0';
+        }
+    }
+    active_bank = img->active < KEYPATCH_BANKS ? img->active : 0;
+    rebuild_note_map();
+    printf("[KP] loaded %d banks from flash, bank %u active\n", KEYPATCH_BANKS, active_bank);
+    return true;
+}
+
+static void program_sector(void *param) {
+    const uint8_t *image = (const uint8_t *)param;
+    flash_range_erase(KEYPATCH_FLASH_OFFSET, FLASH_SECTOR_SIZE);
+    flash_range_program(KEYPATCH_FLASH_OFFSET, image, KEYPATCH_IMAGE_SIZE);
+}
+
+bool keypatch_save_flash(void) {
+    static uint8_t page_buf[KEYPATCH_IMAGE_SIZE];
+    keypatch_image_t *img = (keypatch_image_t *)page_buf;
+
+    memset(page_buf, 0xFF, sizeof(page_buf));
+    img->magic      = KEYPATCH_MAGIC;
+    img->version    = KEYPATCH_VERSION;
+    img->bank_count = KEYPATCH_BANKS;
+    img->active     = active_bank;
+    img->reserved   = 0;
+    memcpy(img->banks, banks, sizeof(banks));
+    img->crc = crc32_update(0, (const uint8_t *)img->banks, sizeof(img->banks));
+
+    // XIP is off while erasing/programming. flash_safe_execute() keeps the
+    // other core and interrupts off flash for the duration, so USB and the
+    // sequencer alarm stall for the erase+program time (tens of ms).
+    stdio_flush();
+    int rc = flash_safe_execute(program_sector, page_buf, UINT32_MAX);
+    if (rc != PICO_OK) {
+        printf("[KP] flash_safe_execute failed (%d)\n", rc);
+        return false;
+    }
+
+    const uint8_t *readback = (const uint8_t *)(XIP_BASE + KEYPATCH_FLASH_OFFSET);
+    bool ok = memcmp(readback, page_buf, sizeof(page_buf)) == 0;
+    printf("[KP] save to flash %s\n", ok ? "OK" : "FAILED");
+    return ok;
+}
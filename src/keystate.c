@@ -0,0 +1,147 @@
+#include "keystate.h"
+#include <string.h>
+
+static keymask_t raw;          // last edge seen from the hardware
+static keymask_t stable;       // debounced state
+static keymask_t long_fired;   // held keys that already sent KEY_EV_LONG
+
+static uint32_t last_change_ms[KEYSTATE_MAX_KEYS];
+static uint32_t press_ms[KEYSTATE_MAX_KEYS];
+static uint32_t next_repeat_ms[KEYSTATE_MAX_KEYS];
+static uint16_t debounce_ms[KEYSTATE_MAX_KEYS];
+
+static uint16_t long_ms   = KEYSTATE_LONG_MS;
+static uint16_t repeat_ms = KEYSTATE_REPEAT_MS;
+
+static keymask_t chords[KEYSTATE_MAX_CHORDS];
+static uint8_t   n_chords;
+static uint8_t   chord_latched;   // bit per chord: fired, waiting for a key to lift
+
+static key_event_t queue[KEYSTATE_QUEUE_LEN];
+static uint32_t    q_head, q_tail;
+static uint32_t    overflows;
+
+static void push(uint8_t type, uint8_t key, uint8_t chord, uint32_t now_ms) {
+    if (q_head - q_tail == KEYSTATE_QUEUE_LEN) {
+        overflows++;
+        return;
+    }
+    key_event_t *ev = &queue[q_head++ & (KEYSTATE_QUEUE_LEN - 1)];
+    ev->type  = type;
+    ev->key   = key;
+    ev->chord = chord;
+    ev->t_ms  = now_ms;
+}
+
+void keystate_init(void) {
+    raw = stable = long_fired = 0;
+    n_chords = 0;
+    chord_latched = 0;
+    q_head = q_tail = 0;
+    overflows = 0;
+    memset(last_change_ms, 0, sizeof(last_change_ms));
+    for (int k = 0; k < KEYSTATE_MAX_KEYS; k++) debounce_ms[k] = KEYSTATE_DEBOUNCE_MS;
+}
+
+void keystate_set_debounce(int key, uint16_t ms) {
+    if (key < 0) {
+        for (int k = 0; k < KEYSTATE_MAX_KEYS; k++) debounce_ms[k] = ms;
+    } else if (key < KEYSTATE_MAX_KEYS) {
+        debounce_ms[key] = ms;
+    }
+}
+
+void keystate_set_hold(uint16_t long_press_ms, uint16_t repeat_interval_ms) {
+    long_ms   = long_press_ms;
+    repeat_ms = repeat_interval_ms;
+}
+
+int keystate_add_chord(keymask_t mask) {
+    if (n_chords == KEYSTATE_MAX_CHORDS || __builtin_popcountll(mask) < 2) return -1;
+    chords[n_chords] = mask;
+    return n_chords++;
+}
+
+static void commit(int key, uint32_t now_ms) {
+    keymask_t bit = KEYMASK(key);
+    stable ^= bit;
+    last_change_ms[key] = now_ms;
+
+    if (stable & bit) {
+        press_ms[key] = now_ms;
+        long_fired &= ~bit;
+        push(KEY_EV_PRESS, (uint8_t)key, 0, now_ms);
+
+        for (uint8_t c = 0; c < n_chords; c++) {
+            if ((chords[c] & bit) && !(chord_latched & (1u << c)) &&
+                (stable & chords[c]) == chords[c]) {
+                chord_latched |= (uint8_t)(1u << c);
+                push(KEY_EV_CHORD, (uint8_t)key, c, now_ms);
+            }
+        }
+    } else {
+        long_fired &= ~bit;
+        push(KEY_EV_RELEASE, (uint8_t)key, 0, now_ms);
+
+        // A chord re-arms once any of its keys lifts
+        for (uint8_t c = 0; c < n_chords; c++) {
+            if (chords[c] & bit) chord_latched &= (uint8_t)~(1u << c);
+        }
+    }
+}
+
+void keystate_feed(int key, bool down, uint32_t now_ms) {
+    if ((unsigned)key >= KEYSTATE_MAX_KEYS) return;
+    keymask_t bit = KEYMASK(key);
+
+    if (down) raw |= bit;
+    else      raw &= ~bit;
+
+    // Leading-edge debounce: take the first edge immediately, ignore
+    // chatter inside the window; keystate_tick() settles whatever the
+    // raw state ends up as once the window closes.
+    if (((raw ^ stable) & bit) &&
+        now_ms - last_change_ms[key] >= debounce_ms[key]) {
+        commit(key, now_ms);
+    }
+}
+
+void keystate_tick(uint32_t now_ms) {
+    // Only keys whose raw state disagrees with the debounced one
+    for (keymask_t pending = raw ^ stable; pending; pending &= pending - 1) {
+        int k = __builtin_ctzll(pending);
+        if (now_ms - last_change_ms[k] >= debounce_ms[k]) commit(k, now_ms);
+    }
+
+    if (!long_ms) return;
+
+    for (keymask_t held = stable; held; held &= held - 1) {
+        int k = __builtin_ctzll(held);
+        keymask_t bit = KEYMASK(k);
+
+        if (!(long_fired & bit)) {
+            if (now_ms - press_ms[k] >= long_ms) {
+                long_fired |= bit;
+                next_repeat_ms[k] = now_ms + repeat_ms;
+                push(KEY_EV_LONG, (uint8_t)k, 0, now_ms);
+            }
+        } else if (repeat_ms && (int32_t)(now_ms - next_repeat_ms[k]) >= 0) {
+            next_repeat_ms[k] += repeat_ms;
+            push(KEY_EV_REPEAT, (uint8_t)k, 0, now_ms);
+        }
+    }
+}
+
+bool keystate_pop(key_event_t *ev) {
+    if (q_tail == q_head) return false;
+    *ev = queue[q_tail++ & (KEYSTATE_QUEUE_LEN - 1)];
+    return true;
+}
+
+uint32_t keystate_overflows(void) {
+    return overflows;
+}
+
+keymask_t keystate_down(void) {
+    return stable;
+}
@@ -3,6 +3,12 @@
 #include "pico/stdlib.h"
 #include "seesaw.h"
 #include "neotrellis.h"
+#include "keypatch.h"
+#include "usb_midi.h"
+#include "fbstream.h"
+#include "i2c_trace.h"
+#include "sequencer.h"
+#include "sysclock.h"
 #include "tusb_config.h"
 
 
@@ -15,14 +21,51 @@ static void scan_i2c(void) {
     }
 }
 
+// Single-key commands on the UART console
+static void handle_console(void) {
+    int ch = getchar_timeout_us(0);
+    if (ch == PICO_ERROR_TIMEOUT) return;
+
+    switch (ch) {
+    case 't': i2c_trace_dump();  break;
+    case 'c': i2c_trace_clear(); printf("[TRACE] cleared\n"); break;
+    case 'p': i2c_trace_enable(!i2c_trace_enabled());
+              printf("[TRACE] %s\n", i2c_trace_enabled() ? "on" : "paused"); break;
+    case 'f': fbstream_print_stats(); break;
+
+    // Sequencer / looper
+    case 'r': sequencer_record(); break;
+    case 'l': sequencer_play();   break;
+    case 'o': sequencer_overdub(sequencer_state() != SEQ_OVERDUB); break;
+    case 's': sequencer_stop();   break;
+    case '+': sequencer_set_bpm(sequencer_bpm() + 5); break;
+    case '-': sequencer_set_bpm(sequencer_bpm() - 5); break;
+    case 'j': sequencer_print_stats(); sequencer_reset_stats(); break;
+
+    // Key patch banks
+    case 'b': neotrellis_select_bank((uint8_t)((keypatch_active_bank() + 1) % KEYPATCH_BANKS)); break;
+    case 'W': keypatch_save_flash(); break;
+    case 'K': if (keypatch_load_flash()) neotrellis_select_bank(keypatch_active_bank()); break;
+    case 'D': keypatch_load_defaults(); neotrellis_select_bank(0); break;
+
+    // System clock profiles
+    case '1': sysclock_set_profile(SYSCLK_LOW_POWER); break;
+    case '2': sysclock_set_profile(SYSCLK_DEFAULT);   break;
+    case '3': sysclock_set_profile(SYSCLK_OVERCLOCK); break;
+    default: break;
+    }
+}
+
 int main() {
     stdio_init_all();
     setvbuf(stdout, NULL, _IONBF, 0);   
     sleep_ms(500);    
     printf("\n=== NeoTrellis bring-up ===\n");
 
+    sysclock_init();
     seesaw_bus_init(100000);
     pwm_audio_init();  
+    keypatch_init();
     scan_i2c();
     
     if (!neotrellis_reset()) {
@@ -66,6 +109,11 @@ fflush(stdout);
 
     neotrellis_clear_fifo(); 
 
+    // Brought up last: enumeration needs tud_task(), which only the main loop runs
+    fbstream_init();
+    usb_midi_init();
+    sequencer_init();
+
 printf("=== Starting main loop ===\n");
 
 
@@ -76,6 +124,12 @@ while (1) {
         printf("Button %d pressed!\n", idx);
     }
     
+    usb_midi_task();
+    fbstream_task();
+    sequencer_task();
+    neopixel_service();
+    handle_console();
+    
     //sleep_ms(5);  // Poll at 20Hz
 }
 
@@ -1,41 +1,126 @@
 #include "neotrellis.h"
 #include "seesaw.h"
+#include "keypatch.h"
+#include "usb_midi.h"
+#include "fbstream.h"
+#include "keystate.h"
+#include "sequencer.h"
 #include "pico/stdlib.h"
 #include "hardware/pwm.h"
+#include "hardware/clocks.h"
+#include "hardware/sync.h"
 #include <string.h>
 #include <stdio.h>
 
 // === PWM AUDIO SETUP ===
 #define BUZZER_PIN 15  // Change this to whatever GPIO pin you want to use
-#define SYS_CLK_FREQ 150000000  // RP2350 runs at 150 MHz (RP2040 is 125 MHz)
-
-// Musical notes (frequencies in Hz) - chromatic scale starting at C4
-static const uint16_t notes[16] = {
-    262,  // C4  - Button 0
-    277,  // C#4 - Button 1
-    294,  // D4  - Button 2
-    311,  // D#4 - Button 3
-    330,  // E4  - Button 4
-    349,  // F4  - Button 5
-    370,  // F#4 - Button 6
-    392,  // G4  - Button 7
-    415,  // G#4 - Button 8
-    440,  // A4  - Button 9
-    466,  // A#4 - Button 10
-    494,  // B4  - Button 11
-    523,  // C5  - Button 12
-    554,  // C#5 - Button 13
-    587,  // D5  - Button 14
-    622   // D#5 - Button 15
+
+// Top octave (MIDI 120..131, C9..B9) in milli-Hz. Every other note is
+// this table shifted down by whole octaves, so the 128-entry pitch table
+// can be rebuilt at any system clock without floating point.
+// Not const: it stays in RAM because the sequencer IRQ reads it.
+static uint32_t top_octave_mhz[12] = {
+    8372018,   // C9
+    8869844,   // C#9
+    9397273,   // D9
+    9956063,   // D#9
+    10548082,  // E9
+    11175303,  // F9
+    11839822,  // F#9
+    12543854,  // G9
+    13289750,  // G#9
+    14080000,  // A9
+    14917240,  // A#9
+    15804266   // B9
 };
 
-static const char* note_names[16] = {
-    "C4", "C#4", "D4", "D#4", "E4", "F4", "F#4", "G4",
-    "G#4", "A4", "A#4", "B4", "C5", "C#5", "D5", "D#5"
+static const char* note_names[12] = {
+    "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"
 };
 
+#define MIDI_NOTE_COUNT 128
+
+// Forced inline so the sequencer IRQ's copy of it lives in RAM too
+static __force_inline uint32_t midi_note_mhz(uint8_t note) {
+    return top_octave_mhz[note % 12] >> (10 - note / 12);
+}
+
 static uint slice_num;
 
+// PWM wrap is only 16 bits, so low notes need the clock divider as well.
+// These are derived from clock_get_hz(clk_sys) and rebuilt on every clock change.
+typedef struct {
+    uint8_t  div;    // integer clock divider (1..255)
+    uint16_t top;    // wrap value
+} pwm_tone_cfg_t;
+
+static uint32_t       pwm_clk_hz;
+static pwm_tone_cfg_t note_cfg[MIDI_NOTE_COUNT];
+
+// The voice is shared by the key path (main loop) and the sequencer (alarm
+// IRQ). All of this is only written with interrupts disabled; a note-off
+// only silences the voice if the same owner started that same note.
+static uint32_t current_mhz;                  // 0 = silent
+static uint8_t  voice_owner = VOICE_FREE;
+static uint8_t  voice_note  = VOICE_NOTE_NONE;
+
+static pwm_tone_cfg_t pwm_tone_cfg(uint32_t clk_hz, uint32_t freq_mhz) {
+    pwm_tone_cfg_t cfg;
+    uint64_t clk_mhz = (uint64_t)clk_hz * 1000u;
+    // Smallest divider that keeps TOP within 16 bits keeps the most precision
+    uint64_t div = clk_mhz / ((uint64_t)freq_mhz * 65536u) + 1;
+    if (div > 255) div = 255;   // below ~12 Hz at 200 MHz the pitch saturates
+
+    uint64_t top = clk_mhz / (div * freq_mhz) - 1;
+    if (top > 0xFFFF) top = 0xFFFF;
+
+    cfg.div = (uint8_t)div;
+    cfg.top = (uint16_t)top;
+    return cfg;
+}
+
+// Straight register writes: the SDK pwm_set_* helpers are only plain
+// inline and could end up as calls into flash from the IRQ path
+static void __not_in_flash_func(pwm_apply_tone)(const pwm_tone_cfg_t *cfg) {
+    pwm_slice_hw_t *sl = &pwm_hw->slice[slice_num];
+    sl->div = (uint32_t)cfg->div << PWM_CH0_DIV_INT_LSB;
+    sl->top = cfg->top;
+    // Set 50% duty cycle for clean square wave
+    hw_write_masked(&sl->cc, (uint32_t)(cfg->top / 2) << PWM_CH0_CC_A_LSB, PWM_CH0_CC_A_BITS);
+    hw_set_bits(&sl->csr, PWM_CH0_CSR_EN_BITS);
+}
+
+static void __not_in_flash_func(pwm_silence)(void) {
+    hw_clear_bits(&pwm_hw->slice[slice_num].csr, PWM_CH0_CSR_EN_BITS);
+    current_mhz = 0;
+    voice_owner = VOICE_FREE;
+    voice_note  = VOICE_NOTE_NONE;
+}
+
+// Recompute the pitch table for the current system clock. Called from
+// pwm_audio_init() and again by sysclock_set_profile() after a clock change;
+// a tone that is already sounding is re-applied so it stays in tune.
+// The table is built aside and swapped in with interrupts off, so the
+// sequencer never reads a half-written entry.
+void pwm_audio_retune(void) {
+    static pwm_tone_cfg_t fresh[MIDI_NOTE_COUNT];
+    uint32_t clk_hz = clock_get_hz(clk_sys);
+
+    for (int n = 0; n < MIDI_NOTE_COUNT; n++) {
+        fresh[n] = pwm_tone_cfg(clk_hz, midi_note_mhz((uint8_t)n));
+    }
+
+    uint32_t irq = save_and_disable_interrupts();
+    pwm_clk_hz = clk_hz;
+    memcpy(note_cfg, fresh, sizeof(note_cfg));
+    if (current_mhz) {
+        pwm_tone_cfg_t cfg = voice_note < MIDI_NOTE_COUNT ? note_cfg[voice_note]
+                                                          : pwm_tone_cfg(clk_hz, current_mhz);
+        pwm_apply_tone(&cfg);
+    }
+    restore_interrupts(irq);
+}
+
 // Initialize PWM for audio output
 void pwm_audio_init(void) {
     gpio_set_function(BUZZER_PIN, GPIO_FUNC_PWM);
@@ -43,52 +128,90 @@ void pwm_audio_init(void) {
     
     // Start with PWM disabled
     pwm_set_enabled(slice_num, false);
+    current_mhz = 0;
     
-    // Set clock divider to 1 (no division) for maximum precision
-    pwm_set_clkdiv(slice_num, 1.0f);
+    pwm_audio_retune();
     
-    printf("[PWM] Audio init: GPIO %d, Slice %d, Clock %d Hz\n", 
-           BUZZER_PIN, slice_num, SYS_CLK_FREQ);
+    printf("[PWM] Audio init: GPIO %d, Slice %d, Clock %lu Hz\n", 
+           BUZZER_PIN, slice_num, (unsigned long)pwm_clk_hz);
 }
 
 // Play a tone at specified frequency using the correct formula from project overview
-// f_note = f_clk / (TOP + 1)
-// Therefore: TOP = (f_clk / f_note) - 1
+// f_note = f_clk / (DIV * (TOP + 1))
+// Therefore: TOP = (f_clk / (DIV * f_note)) - 1
 void pwm_play_tone(uint16_t frequency) {
     if (frequency == 0) {
-        pwm_set_enabled(slice_num, false);
-        printf("♪ Audio OFF\n");
+        stop_voice();
         return;
     }
     
-    // Calculate TOP value: TOP = (f_clk / f_note) - 1
-    uint32_t top = (SYS_CLK_FREQ / frequency) - 1;
-    
-    // Set 50% duty cycle for clean square wave
-    uint32_t level = top / 2;
-    
-    pwm_set_wrap(slice_num, top);
-    pwm_set_chan_level(slice_num, PWM_CHAN_A, level);
-    pwm_set_enabled(slice_num, true);
+    pwm_tone_cfg_t cfg = pwm_tone_cfg(pwm_clk_hz, (uint32_t)frequency * 1000u);
+
+    uint32_t irq = save_and_disable_interrupts();
+    pwm_apply_tone(&cfg);
+    current_mhz = (uint32_t)frequency * 1000u;
+    voice_owner = VOICE_LIVE;
+    voice_note  = VOICE_NOTE_NONE;     // raw tone, not a MIDI note
+    restore_interrupts(irq);
     
     // Calculate actual frequency for verification
-    float actual_freq = (float)SYS_CLK_FREQ / (top + 1);
+    float actual_freq = (float)pwm_clk_hz / ((float)cfg.div * (cfg.top + 1));
     
-    printf("♪ Playing %d Hz (actual: %.1f Hz, TOP=%u)\n", 
-           frequency, actual_freq, top);
+    printf("♪ Playing %d Hz (actual: %.1f Hz, DIV=%u TOP=%u)\n", 
+           frequency, actual_freq, cfg.div, cfg.top);
 }
 
-// Play a note by button index
-void play_note(int idx) {
-    if (idx < 0 || idx >= 16) return;
+// Silent voice control, safe from the sequencer alarm IRQ: no printf,
+// no divides, no flash access. The newest note always takes the voice.
+void __not_in_flash_func(pwm_voice_on)(uint8_t note, voice_owner_t owner) {
+    if (note >= MIDI_NOTE_COUNT) return;
     
-    pwm_play_tone(notes[idx]);
-    printf("🎵 Note: %s (%d Hz)\n", note_names[idx], notes[idx]);
+    uint32_t irq = save_and_disable_interrupts();
+    // Table lookup instead of pwm_play_tone(): no divides on the key path
+    pwm_apply_tone(&note_cfg[note]);
+    current_mhz = midi_note_mhz(note);
+    voice_owner = (uint8_t)owner;
+    voice_note  = note;
+    restore_interrupts(irq);
+}
+
+// Silences the voice only if `owner` started `note` (VOICE_NOTE_ANY: any
+// note of that owner). Returns true if it did.
+bool __not_in_flash_func(pwm_voice_off)(uint8_t note, voice_owner_t owner) {
+    bool hit;
+    uint32_t irq = save_and_disable_interrupts();
+    hit = voice_owner == (uint8_t)owner &&
+          (note == VOICE_NOTE_ANY || note == voice_note);
+    if (hit) pwm_silence();
+    restore_interrupts(irq);
+    return hit;
 }
 
-// Stop playing
-void stop_note(void) {
-    pwm_play_tone(0);
+// Play a MIDI note number (60 = C4)
+void play_note(uint8_t note) {
+    if (note >= MIDI_NOTE_COUNT) return;
+    
+    pwm_voice_on(note, VOICE_LIVE);
+    uint32_t mhz = midi_note_mhz(note);
+    printf("🎵 Note: %s%d (%lu.%03lu Hz)\n", note_names[note % 12], note / 12 - 1,
+           (unsigned long)(mhz / 1000), (unsigned long)(mhz % 1000));
+}
+
+// Stop a note, but only if it is the one sounding: a release (or MIDI
+// note-off) for an older note, or one the sequencer has since taken over,
+// must not cut what is playing now. Returns true if it did stop.
+bool stop_note(uint8_t note) {
+    if (!pwm_voice_off(note, VOICE_LIVE)) return false;
+    printf("♪ Audio OFF\n");
+    return true;
+}
+
+// Stop playing, whatever is sounding
+void stop_voice(void) {
+    uint32_t irq = save_and_disable_interrupts();
+    pwm_silence();
+    restore_interrupts(irq);
+    printf("♪ Audio OFF\n");
 }
 
 // === EXISTING CODE BELOW ===
@@ -172,22 +295,98 @@ bool neopixel_begin(uint8_t internal_pin) {
     return true;
 }
 
-bool neopixel_show(void) {
-    uint8_t hdr[2] = { SEESAW_NEOPIXEL_BASE, NEOPIXEL_SHOW };
-    int wrote = i2c_write_blocking(NEOTRELLIS_I2C, NEOTRELLIS_ADDR, hdr, 2, false);
-    
-    if (wrote != 2) {
+// What the pixels should show, GRB. The seesaw keeps its own buffer, so
+// changing one key only means rewriting its 3 bytes; the others stay lit.
+static uint8_t  led_shadow[NEOTRELLIS_BYTES];
+static uint16_t led_dirty;          // shadow pixels not yet written to the seesaw
+static bool     led_unlatched;      // written, SHOW still to come
+static bool     led_streaming;      // fbstream had the LEDs on the last pass
+
+static uint64_t bus_free_at_us;     // end of the settle window after the last SHOW
+static uint32_t latch_count;
+static uint64_t last_latch_us;
+
+// Issue SHOW without waiting; no LED writes until neopixel_bus_ready()
+bool neopixel_latch(void) {
+    // Header-only write; going through seesaw_write() keeps it in the bus trace
+    if (!seesaw_write(NEOTRELLIS_ADDR, SEESAW_NEOPIXEL_BASE, NEOPIXEL_SHOW, NULL, 0)) {
         printf("SHOW command FAILED!\n");
         return false;
     }
+    last_latch_us  = time_us_64();
+    bus_free_at_us = last_latch_us + NEOPIXEL_SETTLE_US;
+    latch_count++;
+    return true;
+}
+
+bool neopixel_bus_ready(void) {
+    return time_us_64() >= bus_free_at_us;
+}
+
+uint32_t neopixel_latch_count(void) {
+    return latch_count;
+}
+
+uint64_t neopixel_last_latch_us(void) {
+    return last_latch_us;
+}
+
+bool neopixel_show(void) {
+    if (!neopixel_latch()) return false;
     
     sleep_ms(10);  
     return true;
 }
 
+bool neopixel_stage(int idx, uint8_t r, uint8_t g, uint8_t b) {
+    if ((unsigned)idx >= NEOTRELLIS_LED_COUNT) return false;
+
+    uint8_t *px = &led_shadow[3 * idx];
+    if (px[0] == g && px[1] == r && px[2] == b) return false;
+    px[0] = g;
+    px[1] = r;
+    px[2] = b;
+    led_dirty |= (uint16_t)(1u << idx);
+    return true;
+}
+
+// 27 bytes: one neopixel_buf_write() transfer
+#define LED_SPAN_PIXELS 9
+
+void neopixel_service(void) {
+    // A host framebuffer stream owns the LEDs while it is running;
+    // once it stops the whole shadow is put back
+    if (fbstream_active()) {
+        led_streaming = true;
+        return;
+    }
+    if (led_streaming) {
+        led_streaming = false;
+        led_dirty = 0xFFFF;
+    }
+
+    if (!neopixel_bus_ready()) return;
+
+    if (led_dirty) {
+        int lo = __builtin_ctz(led_dirty);
+        int hi = 31 - __builtin_clz(led_dirty);
+        if (hi - lo >= LED_SPAN_PIXELS) hi = lo + LED_SPAN_PIXELS - 1;
+
+        uint16_t start = (uint16_t)(3 * lo);
+        // On a bus error the pixels stay dirty and are retried next pass
+        if (!neopixel_buf_write(start, &led_shadow[start], (size_t)(3 * (hi - lo + 1)))) return;
+
+        led_dirty &= (uint16_t)~(((1u << (hi - lo + 1)) - 1u) << lo);
+        led_unlatched = true;
+        return;
+    }
+
+    if (led_unlatched && neopixel_latch()) led_unlatched = false;
+}
+
 #define DBG(fmt, ...)  printf("[NEO] " fmt "\n", ##__VA_ARGS__)
 
-static bool neopixel_buf_write(uint16_t start, const uint8_t *data, size_t len) {
+bool neopixel_buf_write(uint16_t start, const uint8_t *data, size_t len) {
     while (len) {
         size_t n = len > 28 ? 28 : len;  
         uint8_t payload[2 + 28];
@@ -216,14 +415,11 @@ bool neopixel_set_one_and_show(int idx, uint8_t r, uint8_t g, uint8_t b) {
     if ((unsigned)idx >= 16) { printf("idx out of range\n"); return false; }
 
     uint16_t start = (uint16_t)(idx * 3);
-    uint8_t  grb[3] = { g, r, b };           
-    
-    uint8_t zeros[48] = {0};
-    neopixel_buf_write(0, zeros, 28);   
-    sleep_ms(2);
-    neopixel_buf_write(28, zeros + 28, 20);  
-    sleep_ms(2);
-    neopixel_show();
+    uint8_t *grb = &led_shadow[start];
+    grb[0] = g;
+    grb[1] = r;
+    grb[2] = b;
+    led_dirty &= (uint16_t)~(1u << idx);
     
     if (!neopixel_buf_write(start, grb, 3)) {
         printf("BUF write failed (idx=%d start=%u)\n", idx, start);
@@ -242,6 +438,8 @@ bool neopixel_fill_all_and_show(uint8_t r, uint8_t g, uint8_t b) {
         frame[3 * i + 1] = r;
         frame[3 * i + 2] = b;
     }
+    memcpy(led_shadow, frame, sizeof(led_shadow));
+    led_dirty = 0;
     if (!neopixel_buf_write(0, frame, 48)) {
         printf("neopixel_fill_all_and_show: buf_write failed\n");
         return false;
@@ -300,6 +498,9 @@ static const uint8_t neotrellis_key_lut[16] = {
     24, 25, 26, 27
 };
 
+// Seesaw key number (0..63) back to our 0..15 index, -1 if unused
+static int8_t key_from_keynum[64];
+
 static bool set_keypad_event(uint8_t key, uint8_t edge, bool enable) {
     uint8_t ks = 0;
     if (enable) {
@@ -321,6 +522,11 @@ static bool set_keypad_event(uint8_t key, uint8_t edge, bool enable) {
 
 bool neotrellis_keypad_init(void) {
     printf("[neo] keypad_init: start\n");
+
+    memset(key_from_keynum, -1, sizeof(key_from_keynum));
+    for (int i = 0; i < 16; i++) key_from_keynum[neotrellis_key_lut[i]] = (int8_t)i;
+
+    keystate_init();
     
     uint8_t val = 0x01;
     if (!seesaw_write(NEOTRELLIS_ADDR, SEESAW_KEYPAD_BASE, KEYPAD_INTEN, &val, 1)) {
@@ -346,114 +552,118 @@ bool neotrellis_keypad_init(void) {
     return true;
 }
 
-void set_led_for_idx(int idx, bool on)
+static uint16_t latched_mask;   // keys currently held on by KP_FLAG_LATCH
+
+// The voice is monophonic, so a newer note cuts a latched one. Each latch
+// is stamped when it engages; when the sounding key lets go, the newest
+// latch still engaged takes the voice back.
+static uint32_t latch_stamp[NEOTRELLIS_LED_COUNT];
+static uint32_t latch_clock;
+
+static void latch_engage(int idx, bool on)
 {
-    if (!on) {
-        // Turn off LED and stop note
-        neopixel_set_one_and_show(idx, 0x00, 0x00, 0x00);
-        stop_note();
-        printf("Button %d OFF\n", idx);
-        return;
+    if (on) {
+        latched_mask |= (uint16_t)(1u << idx);
+        latch_stamp[idx] = ++latch_clock;
+    } else {
+        latched_mask &= (uint16_t)~(1u << idx);
     }
+}
 
-    // Button is being pressed - light it up, print, and play note!
-    if (idx == 0)  { 
-        neopixel_set_one_and_show(0, 0x20, 0x00, 0x00); 
-        printf("🔴 Button 0 PRESSED - Red\n");
-        play_note(0);
-    }
-    if (idx == 1)  { 
-        neopixel_set_one_and_show(1, 0x00, 0x20, 0x00); 
-        printf("🟢 Button 1 PRESSED - Green\n");
-        play_note(1);
-    }
-    if (idx == 2)  { 
-        neopixel_set_one_and_show(2, 0x00, 0x00, 0x20); 
-        printf("🔵 Button 2 PRESSED - Blue\n");
-        play_note(2);
-    }
-    if (idx == 3)  { 
-        neopixel_set_one_and_show(3, 0x20, 0x20, 0x00); 
-        printf("🟡 Button 3 PRESSED - Yellow\n");
-        play_note(3);
+static void latch_resume(void)
+{
+    int newest = -1;
+    for (uint16_t m = latched_mask; m; m &= (uint16_t)(m - 1u)) {
+        int k = __builtin_ctz(m);
+        if (newest < 0 || latch_stamp[k] > latch_stamp[newest]) newest = k;
     }
+    if (newest < 0) return;
 
-    if (idx == 4)  { 
-        neopixel_set_one_and_show(4, 0x20, 0x00, 0x20); 
-        printf("🟣 Button 4 PRESSED - Magenta\n");
-        play_note(4);
-    }
-    if (idx == 5)  { 
-        neopixel_set_one_and_show(5, 0x00, 0x20, 0x20); 
-        printf("🔷 Button 5 PRESSED - Cyan\n");
-        play_note(5);
-    }
-    if (idx == 6)  { 
-        neopixel_set_one_and_show(6, 0x10, 0x10, 0x20); 
-        printf("💙 Button 6 PRESSED - Bluish\n");
-        play_note(6);
-    }
-    if (idx == 7)  { 
-        neopixel_set_one_and_show(7, 0x20, 0x10, 0x00); 
-        printf("🟠 Button 7 PRESSED - Orange\n");
-        play_note(7);
-    }
+    const key_patch_t *p = keypatch_get(newest);
+    if (p && !(p->flags & KP_FLAG_MUTE) && p->note != KP_NOTE_NONE) play_note(p->note);
+}
 
-    if (idx == 8)  { 
-        neopixel_set_one_and_show(8, 0x10, 0x20, 0x00); 
-        printf("🌿 Button 8 PRESSED - Yellow-Green\n");
-        play_note(8);
-    }
-    if (idx == 9)  { 
-        neopixel_set_one_and_show(9, 0x00, 0x10, 0x20); 
-        printf("🌊 Button 9 PRESSED - Teal\n");
-        play_note(9);
-    }
-    if (idx == 10) { 
-        neopixel_set_one_and_show(10, 0x20, 0x00, 0x10); 
-        printf("💗 Button 10 PRESSED - Pink-Red\n");
-        play_note(10);
-    }
-    if (idx == 11) { 
-        neopixel_set_one_and_show(11, 0x10, 0x00, 0x20); 
-        printf("💜 Button 11 PRESSED - Violet\n");
-        play_note(11);
-    }
+// Physical edge -> logical key state. Latch keys toggle on press and
+// ignore release. Returns 1 (on), 0 (off) or -1 (no change).
+int neotrellis_key_edge(int idx, bool pressed)
+{
+    const key_patch_t *p = keypatch_get(idx);
+    if (!p) return -1;
+    if (!(p->flags & KP_FLAG_LATCH)) return pressed;
+    if (!pressed) return -1;
+
+    bool on = !((latched_mask >> idx) & 1u);
+    latch_engage(idx, on);
+    return on;
+}
 
-    if (idx == 12) { 
-        neopixel_set_one_and_show(12, 0x05, 0x20, 0x05); 
-        printf("🍃 Button 12 PRESSED - Light Green\n");
-        play_note(12);
-    }
-    if (idx == 13) { 
-        neopixel_set_one_and_show(13, 0x20, 0x05, 0x05); 
-        printf("❤️  Button 13 PRESSED - Light Red\n");
-        play_note(13);
-    }
-    if (idx == 14) { 
-        neopixel_set_one_and_show(14, 0x05, 0x05, 0x20); 
-        printf("💎 Button 14 PRESSED - Light Blue\n");
-        play_note(14);
-    }
-    if (idx == 15) { 
-        neopixel_set_one_and_show(15, 0x20, 0x10, 0x20); 
-        printf("🌸 Button 15 PRESSED - Lavender\n");
-        play_note(15);
-    }
+// Absolute key state from elsewhere (MIDI in): keeps latches in step
+void neotrellis_key_set_latch(int idx, bool on)
+{
+    const key_patch_t *p = keypatch_get(idx);
+    if (!p || !(p->flags & KP_FLAG_LATCH)) return;
+    if (on == ((latched_mask >> idx) & 1u)) return;
+
+    latch_engage(idx, on);
 }
 
-bool neotrellis_poll_buttons(int *idx_out)
+// Voice half of a key: PWM only, no bus traffic
+void neotrellis_key_voice(int idx, bool on)
+{
+    const key_patch_t *p = keypatch_get(idx);
+    if (!p || (p->flags & KP_FLAG_MUTE) || p->note == KP_NOTE_NONE) return;
+
+    if (on) play_note(p->note);
+    else if (stop_note(p->note)) latch_resume();
+}
+
+// LED half of a key: only staged here, neopixel_service() uploads it
+void neotrellis_key_led(int idx, bool on)
+{
+    const key_patch_t *p = keypatch_get(idx);
+    if (!p || (p->flags & KP_FLAG_DARK)) return;
+
+    if (on) neopixel_stage(idx, p->r, p->g, p->b);
+    else    neopixel_stage(idx, 0x00, 0x00, 0x00);
+}
+
+// Apply a logical key state (already latch-resolved)
+void set_led_for_idx(int idx, bool on)
+{
+    const key_patch_t *p = keypatch_get(idx);
+    if (!p) return;
+
+    neotrellis_key_led(idx, on);
+    neotrellis_key_voice(idx, on);
+
+    if (on) printf("Button %d PRESSED - %s\n", idx, p->label);
+    else    printf("Button %d OFF\n", idx);
+}
+
+void neotrellis_select_bank(uint8_t bank)
+{
+    if (!keypatch_select_bank(bank)) return;
+    latched_mask = 0;
+    stop_voice();
+}
+
+// Time of each key's latest raw edge, read as it comes off the FIFO. The
+// debounced event for it may only commit on a later pass, so the
+// sequencer records this rather than the event time.
+static uint64_t edge_us[NEOTRELLIS_LED_COUNT];
+
+// Raw keypad edges go into the key-state engine; everything below acts
+// on its debounced events, not on the FIFO directly.
+static void drain_keypad_fifo(void)
 {
     uint8_t count = 0;
-    bool found_press = false;
-    int result_idx = -1;
     
     if (!seesaw_read(NEOTRELLIS_ADDR, SEESAW_KEYPAD_BASE, KEYPAD_COUNT, &count, 1)) {
-        return false;
+        return;
     }
     
-    if (count == 0) {
-        return false;
+    if (count == 0 || count == 0xFF) {
+        return;
     }
     
     if (count > 8) count = 8;
@@ -471,29 +681,70 @@ bool neotrellis_poll_buttons(int *idx_out)
             continue;
         }
 
-        int idx = -1;
-        for (int i = 0; i < 16; i++) {
-            if (neotrellis_key_lut[i] == keynum) {
-                idx = i;
-                break;
-            }
-        }
+        int idx = key_from_keynum[keynum & 0x3F];
         if (idx < 0) {
             continue;
         }
 
-        if (edge == SEESAW_KEYPAD_EDGE_RISING) {
+        edge_us[idx] = time_us_64();
+        uint32_t now_ms = (uint32_t)(edge_us[idx] / 1000u);
+
+        if (edge == SEESAW_KEYPAD_EDGE_RISING)       keystate_feed(idx, true, now_ms);
+        else if (edge == SEESAW_KEYPAD_EDGE_FALLING) keystate_feed(idx, false, now_ms);
+    }
+}
+
+bool neotrellis_poll_buttons(int *idx_out)
+{
+    bool found_press = false;
+    int result_idx = -1;
+    drain_keypad_fifo();
+    keystate_tick(to_ms_since_boot(get_absolute_time()));
+
+    // Pass 1: queue MIDI for every debounced edge, so the whole batch goes
+    // out over USB before any local feedback is logged.
+    key_event_t events[KEYSTATE_QUEUE_LEN];
+    uint8_t n_events = 0;
+    key_event_t ev;
+
+    while (n_events < KEYSTATE_QUEUE_LEN && keystate_pop(&ev)) {
+        if (ev.type == KEY_EV_PRESS || ev.type == KEY_EV_RELEASE) {
+            // From here on PRESS/RELEASE mean logical on/off (latches resolved)
+            int on = neotrellis_key_edge(ev.key, ev.type == KEY_EV_PRESS);
+            if (on < 0) continue;
+            ev.type = on ? KEY_EV_PRESS : KEY_EV_RELEASE;
+
+            usb_midi_key_event(ev.key, on);
+            sequencer_record_key(ev.key, on, edge_us[ev.key]);
+        }
+        events[n_events++] = ev;
+    }
+
+    usb_midi_flush();
+
+    // Pass 2: local feedback
+    for (uint8_t e = 0; e < n_events; e++) {
+        int idx = events[e].key;
+
+        switch (events[e].type) {
+        case KEY_EV_PRESS:
             set_led_for_idx(idx, true);
             
             if (!found_press) {
                 result_idx = idx;
                 found_press = true;
-                printf("[neo] Button %d PRESSED (keynum=%u)\n", idx, keynum);
+                printf("[neo] Button %d PRESSED (keynum=%u)\n", idx, neotrellis_key_lut[idx]);
             }
-        }
-        else if (edge == SEESAW_KEYPAD_EDGE_FALLING) {
+            break;
+
+        case KEY_EV_RELEASE:
             set_led_for_idx(idx, false);
-            printf("[neo] Button %d RELEASED (keynum=%u)\n", idx, keynum);
+            printf("[neo] Button %d RELEASED (keynum=%u)\n", idx, neotrellis_key_lut[idx]);
+            break;
+
+        default:
+            // Chord / long / repeat events have no local use yet
+            break;
         }
     }
     
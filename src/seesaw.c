@@ -1,9 +1,22 @@
 #include "seesaw.h"
+#include "i2c_trace.h"
 #include "pico/stdlib.h"
 #include <string.h>
 
+#if SEESAW_TRACE
+#define TRACE_BEGIN()  uint32_t trace_t0 = time_us_32()
+#define TRACE_END(dir, module, reg, data, len, ok) \
+    i2c_trace_record((dir), addr, (module), (reg), (data), (uint16_t)(len), (ok), \
+                     trace_t0, time_us_32())
+#else
+#define TRACE_BEGIN()                              ((void)0)
+#define TRACE_END(dir, module, reg, data, len, ok) ((void)0)
+#endif
+
+static uint32_t bus_hz;      // requested baud, kept so a clock change can re-apply it
 
 void seesaw_bus_init(uint32_t hz) {
+    bus_hz = hz;
     i2c_init(NEOTRELLIS_I2C, hz);
     gpio_set_function(NEOTRELLIS_SDA, GPIO_FUNC_I2C);
     gpio_set_function(NEOTRELLIS_SCL, GPIO_FUNC_I2C);
@@ -12,6 +25,11 @@ void seesaw_bus_init(uint32_t hz) {
     
 }
 
+uint32_t seesaw_bus_retune(void) {
+    // i2c_set_baudrate() derives its SCL counts from clock_get_hz(clk_peri)
+    return i2c_set_baudrate(NEOTRELLIS_I2C, bus_hz);
+}
+
 
 
 bool seesaw_write(uint8_t addr, uint8_t module, uint8_t reg,
@@ -21,8 +39,11 @@ bool seesaw_write(uint8_t addr, uint8_t module, uint8_t reg,
     buf[1] = reg;
     for (uint16_t i = 0; i < len; i++) buf[2 + i] = data[i];
 
+    TRACE_BEGIN();
     int written = i2c_write_blocking(NEOTRELLIS_I2C, addr, buf, 2 + len, false);
-    return written == (int)(2 + len);
+    bool ok = written == (int)(2 + len);
+    TRACE_END(I2C_TRACE_WRITE, module, reg, data, len, ok);
+    return ok;
 }
 
 
@@ -45,11 +66,12 @@ bool seesaw_write_buf(uint8_t addr, uint8_t module, uint8_t reg,
 
 
 
+    TRACE_BEGIN();
     int wrote = i2c_write_blocking(NEOTRELLIS_I2C, addr, frame, total, false);
-
-
+    bool ok = wrote == (int)total;
+    TRACE_END(I2C_TRACE_WRITE_BUF, module, reg, data, len, ok);
     
-    return wrote == (int)total;
+    return ok;
 }
 
 
@@ -60,8 +82,14 @@ bool seesaw_read(uint8_t addr, uint8_t module, uint8_t reg,
                  uint8_t *data, uint16_t len) {
     uint8_t hdr[2] = { module, reg };
 
-    if (i2c_write_blocking(NEOTRELLIS_I2C, addr, hdr, 2, true) < 0) return false;
+    TRACE_BEGIN();
+    if (i2c_write_blocking(NEOTRELLIS_I2C, addr, hdr, 2, true) < 0) {
+        TRACE_END(I2C_TRACE_READ, module, reg, NULL, len, false);
+        return false;
+    }
 
     sleep_us(300);
-    return i2c_read_blocking(NEOTRELLIS_I2C, addr, data, len, false) >= 0;
+    bool ok = i2c_read_blocking(NEOTRELLIS_I2C, addr, data, len, false) >= 0;
+    TRACE_END(I2C_TRACE_READ, module, reg, ok ? data : NULL, len, ok);
+    return ok;
 }
\ No newline at end of file
@@ -0,0 +1,468 @@
+#include "sequencer.h"
+#include "neotrellis.h"
+#include "keypatch.h"
+#include "pico/stdlib.h"
+#include "hardware/timer.h"
+#include "hardware/sync.h"
+#include <string.h>
+#include <stdio.h>
+
+typedef struct {
+    uint32_t tick;      // position inside the loop
+    uint8_t  key;
+    uint8_t  note;      // KP_NOTE_NONE: LED only
+    uint8_t  on;
+    uint8_t  grb[3];    // colour captured at record time
+} seq_step_t;
+
+static seq_step_t        steps[SEQ_MAX_STEPS];
+static volatile uint16_t n_steps;
+static uint32_t          loop_ticks;
+
+static volatile seq_state_t state;
+static uint16_t             bpm = SEQ_BPM_DEFAULT;
+static int                  alarm_num = -1;
+
+// Absolute tick T (counting across loop passes) is due at
+//   anchor_us + (T - anchor_tick) * 60e6 / (bpm * SEQ_PPQN)
+// Tempo changes move the anchor to the last whole tick already passed
+// instead of rescaling from the start, so nothing already played shifts
+// and rounding never drifts.
+static uint64_t          anchor_us;
+static uint64_t          anchor_tick;
+static uint64_t          pass_base_tick;   // absolute tick of tick 0 of the armed pass
+static volatile uint16_t next_idx;
+static uint64_t          next_target_us;
+
+// Recording. Steps keep their raw offset until sequencer_play() or
+// sequencer_stop() closes the take, so a tempo change mid-take still
+// quantises every step and the loop length at the same BPM.
+static uint64_t rec_start_us;
+static uint32_t rec_us[SEQ_MAX_STEPS];     // offset from rec_start_us per step
+static uint16_t rec_open;                  // keys with a recorded press but no release
+static uint8_t  rec_note[NEOTRELLIS_LED_COUNT];
+
+// Pixels changed by the IRQ, copied into the shared LED shadow by
+// sequencer_task(); only keys the sequencer touched are written there
+static uint8_t           frame[NEOTRELLIS_BYTES];
+static volatile uint16_t frame_dirty;
+static uint16_t          frame_lit;        // keys the sequencer has lit
+static volatile uint64_t frame_due_us;
+
+// Tick-to-latch: the first SHOW after staging carries the change
+static bool     lat_waiting;
+static uint64_t lat_due_us;
+static uint32_t lat_latch_gen;
+
+static seq_stats_t stats;
+
+static inline uint64_t ticks_to_us(uint64_t ticks) {
+    return ticks * 60000000ull / ((uint32_t)bpm * SEQ_PPQN);
+}
+
+static inline uint64_t us_to_ticks(uint64_t us) {
+    return us * ((uint32_t)bpm * SEQ_PPQN) / 60000000ull;
+}
+
+static inline uint64_t tick_due_us(uint64_t abs_tick) {
+    return anchor_us + ticks_to_us(abs_tick - anchor_tick);
+}
+
+// --- IRQ side --------------------------------------------------------------
+//
+// The lead spin and the voice change run from RAM. The SDK alarm
+// dispatcher before them and hardware_alarm_set_target() after them live
+// in flash; the first is covered by SEQ_ALARM_LEAD_US, the second happens
+// once the step has already sounded.
+
+// time_us_64() is an out-of-line SDK call; read the raw timer instead
+static __force_inline uint64_t now_us(void) {
+    uint32_t hi = timer_hw->timerawh;
+    uint32_t lo;
+    for (;;) {
+        lo = timer_hw->timerawl;
+        uint32_t hi2 = timer_hw->timerawh;
+        if (hi == hi2) break;
+        hi = hi2;
+    }
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static void __not_in_flash_func(apply_step)(const seq_step_t *st, uint64_t target_us) {
+    uint64_t now = now_us();
+
+    // Live playing may have taken the voice since; pwm_voice_off() then
+    // leaves it alone
+    if (st->note != KP_NOTE_NONE) {
+        if (st->on) pwm_voice_on(st->note, VOICE_SEQ);
+        else        pwm_voice_off(st->note, VOICE_SEQ);
+    }
+
+    uint32_t jitter = (uint32_t)(now > target_us ? now - target_us : target_us - now);
+    if (jitter > stats.jitter_max_us) stats.jitter_max_us = jitter;
+    if (jitter < stats.jitter_min_us) stats.jitter_min_us = jitter;
+    stats.jitter_sum_us += jitter;
+    stats.fired++;
+
+    uint8_t *px = &frame[3 * st->key];
+    uint16_t bit = (uint16_t)(1u << st->key);
+    if (st->on) {
+        memcpy(px, st->grb, 3);
+        frame_lit |= bit;
+    } else {
+        memset(px, 0, 3);
+        frame_lit &= (uint16_t)~bit;
+    }
+    frame_dirty |= bit;
+    frame_due_us = target_us;
+}
+
+// Called from the IRQ or with interrupts disabled
+static void __not_in_flash_func(arm_next)(void) {
+    for (;;) {
+        if (next_idx >= n_steps) {
+            next_idx = 0;
+            pass_base_tick += loop_ticks;
+        }
+        next_target_us = tick_due_us(pass_base_tick + steps[next_idx].tick);
+
+        uint64_t fire_at = next_target_us > SEQ_ALARM_LEAD_US
+                         ? next_target_us - SEQ_ALARM_LEAD_US : 0;
+        if (!hardware_alarm_set_target((uint)alarm_num, from_us_since_boot(fire_at))) {
+            return;
+        }
+
+        // Target already in the past: apply now rather than skip it
+        stats.missed++;
+        apply_step(&steps[next_idx], next_target_us);
+        next_idx++;
+    }
+}
+
+static void __not_in_flash_func(alarm_irq)(uint alarm) {
+    (void)alarm;
+    if (state < SEQ_PLAYING || !n_steps) return;
+
+    // The alarm fires SEQ_ALARM_LEAD_US early to absorb IRQ entry latency
+    uint64_t target = next_target_us;
+    while (now_us() < target) tight_loop_contents();
+
+    uint32_t tick = steps[next_idx].tick;
+    do {
+        apply_step(&steps[next_idx], target);
+        next_idx++;
+    } while (next_idx < n_steps && steps[next_idx].tick == tick);
+
+    arm_next();
+}
+
+// --- main-loop side --------------------------------------------------------
+
+bool sequencer_init(void) {
+    alarm_num = hardware_alarm_claim_unused(false);
+    if (alarm_num < 0) {
+        printf("[SEQ] no free hardware alarm\n");
+        return false;
+    }
+    hardware_alarm_set_callback((uint)alarm_num, alarm_irq);
+    sequencer_reset_stats();
+    printf("[SEQ] alarm %d, %u BPM, %d PPQN\n", alarm_num, bpm, SEQ_PPQN);
+    return true;
+}
+
+seq_state_t sequencer_state(void) {
+    return state;
+}
+
+uint16_t sequencer_bpm(void) {
+    return bpm;
+}
+
+static void silence(void) {
+    pwm_voice_off(VOICE_NOTE_ANY, VOICE_SEQ);
+    for (uint16_t m = frame_lit; m; m &= (uint16_t)(m - 1u)) {
+        memset(&frame[3 * __builtin_ctz(m)], 0, 3);
+    }
+    frame_dirty |= frame_lit;
+    frame_lit = 0;
+    frame_due_us = time_us_64();
+}
+
+// Loop position of time t_us while playing. Interrupts must be off.
+static uint32_t loop_pos(uint64_t t_us) {
+    // The armed pass may already be the next one
+    int64_t rel = t_us > anchor_us ? (int64_t)(anchor_tick + us_to_ticks(t_us - anchor_us)) : 0;
+    rel -= (int64_t)pass_base_tick;
+    while (rel < 0) rel += loop_ticks;
+    return (uint32_t)((uint64_t)rel % loop_ticks);
+}
+
+// Insert into the playing loop, keeping tick order. Interrupts must be off.
+static void insert_step(const seq_step_t *st) {
+    uint16_t pos = 0;
+    while (pos < n_steps && steps[pos].tick < st->tick) pos++;
+    memmove(&steps[pos + 1], &steps[pos], (n_steps - pos) * sizeof(seq_step_t));
+    steps[pos] = *st;
+    n_steps++;
+    // Inserted at or before the armed step: it was just played live
+    if (pos <= next_idx) next_idx++;
+}
+
+// Leaving overdub with keys still held: record their releases here, or the
+// loop keeps a note-on that is never switched off
+static void overdub_close_keys(void) {
+    if (state != SEQ_OVERDUB || !rec_open) return;
+
+    uint32_t irq = save_and_disable_interrupts();
+    uint32_t tick = loop_pos(time_us_64());
+    for (int k = 0; k < NEOTRELLIS_LED_COUNT && n_steps < SEQ_MAX_STEPS; k++) {
+        if (!(rec_open & (1u << k))) continue;
+        seq_step_t st = { .tick = tick, .key = (uint8_t)k, .note = rec_note[k], .on = 0 };
+        insert_step(&st);
+    }
+    restore_interrupts(irq);
+    rec_open = 0;
+}
+
+// Quantise the take at the current tempo and close keys still held, so
+// nothing drones. Leaves the loop ready for sequencer_play().
+static void close_recording(void) {
+    uint32_t len = (uint32_t)us_to_ticks(time_us_64() - rec_start_us);
+    // Whole beats, strictly longer than the last recorded step
+    loop_ticks = (len / SEQ_PPQN + 1) * SEQ_PPQN;
+
+    // Keys can commit slightly out of edge order (debounce), so sort too
+    for (uint16_t i = 0; i < n_steps; i++) {
+        seq_step_t st = steps[i];
+        uint32_t   us = rec_us[i];
+        st.tick = (uint32_t)us_to_ticks(us);
+
+        uint16_t j = i;
+        for (; j > 0 && rec_us[j - 1] > us; j--) {
+            steps[j]  = steps[j - 1];
+            rec_us[j] = rec_us[j - 1];
+        }
+        steps[j]  = st;
+        rec_us[j] = us;
+    }
+
+    for (int k = 0; k < NEOTRELLIS_LED_COUNT && n_steps < SEQ_MAX_STEPS; k++) {
+        if (!(rec_open & (1u << k))) continue;
+        seq_step_t *st = &steps[n_steps++];
+        st->tick = loop_ticks - 1;
+        st->key  = (uint8_t)k;
+        st->note = rec_note[k];
+        st->on   = 0;
+        memset(st->grb, 0, sizeof(st->grb));
+    }
+    rec_open = 0;
+    state = SEQ_IDLE;
+}
+
+void sequencer_stop(void) {
+    if (state == SEQ_RECORDING) {
+        // Keep the take; 'play' starts it from here
+        close_recording();
+        printf("[SEQ] recording stopped, %u steps, %lu beats kept\n",
+               n_steps, (unsigned long)(loop_ticks / SEQ_PPQN));
+        return;
+    }
+    if (alarm_num < 0) return;
+
+    overdub_close_keys();
+
+    uint32_t irq = save_and_disable_interrupts();
+    hardware_alarm_cancel((uint)alarm_num);
+    bool was_playing = state >= SEQ_PLAYING;
+    state = SEQ_IDLE;
+    if (was_playing) silence();
+    restore_interrupts(irq);
+
+    printf("[SEQ] stopped\n");
+}
+
+void sequencer_clear(void) {
+    if (state == SEQ_RECORDING) state = SEQ_IDLE;   // discarded anyway
+    sequencer_stop();
+    n_steps    = 0;
+    loop_ticks = 0;
+}
+
+void sequencer_record(void) {
+    sequencer_clear();
+    rec_open     = 0;
+    rec_start_us = time_us_64();
+    state        = SEQ_RECORDING;
+    printf("[SEQ] recording at %u BPM\n", bpm);
+}
+
+void sequencer_play(void) {
+    if (alarm_num < 0) return;
+
+    if (state == SEQ_RECORDING) close_recording();
+    overdub_close_keys();
+
+    if (!n_steps || !loop_ticks) {
+        printf("[SEQ] nothing recorded\n");
+        state = SEQ_IDLE;
+        return;
+    }
+
+    uint32_t irq = save_and_disable_interrupts();
+    hardware_alarm_cancel((uint)alarm_num);
+    anchor_us      = time_us_64() + 1000;   // first pass starts 1 ms out
+    anchor_tick    = 0;
+    pass_base_tick = 0;
+    next_idx       = 0;
+    state          = SEQ_PLAYING;
+    arm_next();
+    restore_interrupts(irq);
+
+    printf("[SEQ] playing %u steps, %lu ticks (%lu beats) at %u BPM\n",
+           n_steps, (unsigned long)loop_ticks,
+           (unsigned long)(loop_ticks / SEQ_PPQN), bpm);
+}
+
+void sequencer_overdub(bool on) {
+    if (state < SEQ_PLAYING) return;
+    if (!on) overdub_close_keys();
+    state = on ? SEQ_OVERDUB : SEQ_PLAYING;
+    printf("[SEQ] overdub %s\n", on ? "on" : "off");
+}
+
+void sequencer_set_bpm(uint16_t new_bpm) {
+    if (new_bpm < SEQ_BPM_MIN) new_bpm = SEQ_BPM_MIN;
+    if (new_bpm > SEQ_BPM_MAX) new_bpm = SEQ_BPM_MAX;
+
+    uint32_t irq = save_and_disable_interrupts();
+    if (state >= SEQ_PLAYING) {
+        uint64_t now = time_us_64();
+        if (now > anchor_us) {
+            // Re-anchor on the last whole tick under the old tempo
+            uint64_t elapsed = us_to_ticks(now - anchor_us);
+            anchor_us   += ticks_to_us(elapsed);
+            anchor_tick += elapsed;
+        }
+        bpm = new_bpm;
+        hardware_alarm_cancel((uint)alarm_num);
+        arm_next();
+    } else {
+        bpm = new_bpm;
+    }
+    restore_interrupts(irq);
+
+    printf("[SEQ] %u BPM\n", bpm);
+}
+
+static void fill_step(seq_step_t *st, uint32_t tick, int idx, bool pressed) {
+    st->tick = tick;
+    st->key  = (uint8_t)idx;
+    st->on   = pressed;
+
+    if (pressed) {
+        const key_patch_t *p = keypatch_get(idx);
+        rec_note[idx] = (p->flags & KP_FLAG_MUTE) ? KP_NOTE_NONE : p->note;
+        st->grb[0] = (p->flags & KP_FLAG_DARK) ? 0 : p->g;
+        st->grb[1] = (p->flags & KP_FLAG_DARK) ? 0 : p->r;
+        st->grb[2] = (p->flags & KP_FLAG_DARK) ? 0 : p->b;
+    } else {
+        memset(st->grb, 0, sizeof(st->grb));
+    }
+    // A release plays back the note its press recorded
+    st->note = rec_note[idx];
+}
+
+void sequencer_record_key(int idx, bool pressed, uint64_t t_us) {
+    if ((unsigned)idx >= NEOTRELLIS_LED_COUNT) return;
+    if (state != SEQ_RECORDING && state != SEQ_OVERDUB) return;
+    // A release whose press was not recorded (held from before) is dropped
+    if (!pressed && !(rec_open & (1u << idx))) return;
+
+    if (n_steps >= SEQ_MAX_STEPS) {
+        printf("[SEQ] step memory full\n");
+        return;
+    }
+
+    if (state == SEQ_RECORDING) {
+        uint64_t rel = t_us > rec_start_us ? t_us - rec_start_us : 0;
+        fill_step(&steps[n_steps], 0, idx, pressed);
+        rec_us[n_steps] = rel > UINT32_MAX ? UINT32_MAX : (uint32_t)rel;
+        n_steps++;
+    } else {
+        seq_step_t st;
+        uint32_t irq = save_and_disable_interrupts();
+        fill_step(&st, loop_pos(t_us), idx, pressed);
+        insert_step(&st);
+        restore_interrupts(irq);
+    }
+
+    if (pressed) rec_open |= (uint16_t)(1u << idx);
+    else         rec_open &= (uint16_t)~(1u << idx);
+}
+
+void sequencer_task(void) {
+    if (lat_waiting && neopixel_latch_count() != lat_latch_gen) {
+        uint64_t latched = neopixel_last_latch_us();
+        uint32_t lat = latched > lat_due_us ? (uint32_t)(latched - lat_due_us) : 0;
+        lat_waiting = false;
+
+        uint32_t irq = save_and_disable_interrupts();
+        stats.led_frames++;
+        stats.led_lat_sum_us += lat;
+        if (lat > stats.led_lat_max_us) stats.led_lat_max_us = lat;
+        restore_interrupts(irq);
+    }
+
+    if (!frame_dirty) return;
+
+    uint8_t  snap[NEOTRELLIS_BYTES];
+    uint16_t dirty;
+    uint64_t due;
+    uint32_t irq = save_and_disable_interrupts();
+    memcpy(snap, frame, sizeof(snap));
+    dirty = frame_dirty;
+    due   = frame_due_us;
+    frame_dirty = 0;
+    restore_interrupts(irq);
+
+    bool changed = false;
+    for (uint16_t m = dirty; m; m &= (uint16_t)(m - 1u)) {
+        const uint8_t *px = &snap[3 * __builtin_ctz(m)];
+        changed |= neopixel_stage(__builtin_ctz(m), px[1], px[0], px[2]);   // GRB -> r, g, b
+    }
+
+    if (changed && !lat_waiting) {
+        lat_waiting   = true;
+        lat_due_us    = due;
+        lat_latch_gen = neopixel_latch_count();
+    }
+}
+
+void sequencer_get_stats(seq_stats_t *out) {
+    if (!out) return;
+    uint32_t irq = save_and_disable_interrupts();
+    *out = stats;
+    restore_interrupts(irq);
+}
+
+void sequencer_reset_stats(void) {
+    uint32_t irq = save_and_disable_interrupts();
+    memset(&stats, 0, sizeof(stats));
+    stats.jitter_min_us = UINT32_MAX;
+    restore_interrupts(irq);
+}
+
+void sequencer_print_stats(void) {
+    seq_stats_t s;
+    sequencer_get_stats(&s);
+
+    printf("[SEQ] steps=%lu missed=%lu jitter us: min=%lu avg=%lu max=%lu\n",
+           (unsigned long)s.fired, (unsigned long)s.missed,
+           (unsigned long)(s.fired ? s.jitter_min_us : 0),
+           (unsigned long)(s.fired ? s.jitter_sum_us / s.fired : 0),
+           (unsigned long)s.jitter_max_us);
+    printf("[SEQ] led frames=%lu tick-to-latch us: avg=%lu max=%lu\n",
+           (unsigned long)s.led_frames,
+           (unsigned long)(s.led_frames ? s.led_lat_sum_us / s.led_frames : 0),
+           (unsigned long)s.led_lat_max_us);
+}
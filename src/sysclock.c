@@ -0,0 +1,83 @@
+#include "sysclock.h"
+#include "seesaw.h"
+#include "neotrellis.h"
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/uart.h"
+#include <stdio.h>
+
+static const uint32_t profile_khz[SYSCLK_PROFILE_COUNT] = {
+    [SYSCLK_LOW_POWER] =  48000,
+    [SYSCLK_DEFAULT]   = 150000,
+    [SYSCLK_OVERCLOCK] = 200000,
+};
+
+static const char *profile_names[SYSCLK_PROFILE_COUNT] = {
+    [SYSCLK_LOW_POWER] = "low-power",
+    [SYSCLK_DEFAULT]   = "default",
+    [SYSCLK_OVERCLOCK] = "overclock",
+};
+
+static sysclk_profile_t current_profile = SYSCLK_PROFILE_COUNT;   // unknown until sysclock_init()
+
+uint32_t sysclock_profile_khz(sysclk_profile_t profile) {
+    if ((unsigned)profile >= SYSCLK_PROFILE_COUNT) return 0;
+    return profile_khz[profile];
+}
+
+const char *sysclock_profile_name(sysclk_profile_t profile) {
+    if ((unsigned)profile >= SYSCLK_PROFILE_COUNT) return "?";
+    return profile_names[profile];
+}
+
+void sysclock_init(void) {
+    uint32_t khz = clock_get_hz(clk_sys) / 1000;
+
+    current_profile = SYSCLK_PROFILE_COUNT;
+    for (int p = 0; p < SYSCLK_PROFILE_COUNT; p++) {
+        if (profile_khz[p] == khz) current_profile = (sysclk_profile_t)p;
+    }
+    printf("[CLK] booted at %lu kHz (%s profile)\n", (unsigned long)khz,
+           current_profile < SYSCLK_PROFILE_COUNT ? profile_names[current_profile] : "no");
+}
+
+sysclk_profile_t sysclock_get_profile(void) {
+    return current_profile;
+}
+
+// Must be called from the main loop (never from an IRQ) so no I2C transfer
+// is in flight while clk_peri moves underneath the bus.
+bool sysclock_set_profile(sysclk_profile_t profile) {
+    if ((unsigned)profile >= SYSCLK_PROFILE_COUNT) return false;
+
+    uint32_t khz = profile_khz[profile];
+    uint vco, postdiv1, postdiv2;
+    if (!check_sys_clock_khz(khz, &vco, &postdiv1, &postdiv2)) {
+        printf("[CLK] %lu kHz not reachable by the PLL\n", (unsigned long)khz);
+        return false;
+    }
+
+    // Drain the console first, the UART divider is about to become stale
+    stdio_flush();
+#ifdef uart_default
+    uart_tx_wait_blocking(uart_default);
+#endif
+
+    if (!set_sys_clock_khz(khz, false)) {
+        return false;
+    }
+
+#ifdef uart_default
+    uart_set_baudrate(uart_default, PICO_DEFAULT_UART_BAUD_RATE);
+#endif
+    uint32_t i2c_hz = seesaw_bus_retune();
+    pwm_audio_retune();
+
+    current_profile = profile;
+    printf("[CLK] profile %s: sys=%lu Hz peri=%lu Hz i2c=%lu Hz\n",
+           profile_names[profile],
+           (unsigned long)clock_get_hz(clk_sys),
+           (unsigned long)clock_get_hz(clk_peri),
+           (unsigned long)i2c_hz);
+    return true;
+}
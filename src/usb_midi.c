@@ -0,0 +1,166 @@
+#include "usb_midi.h"
+#include "keypatch.h"
+#include "neotrellis.h"
+#include "tusb.h"
+#include <stdio.h>
+
+static uint8_t batch[USB_MIDI_BATCH_MAX * 3];   // raw MIDI bytes for this frame
+static uint8_t batch_len;
+
+// Note each key actually sent on press, so its release matches even if the
+// bank changed while the key was held.
+static uint8_t held_note[KEYPATCH_KEYS];
+
+void usb_midi_init(void) {
+    for (int i = 0; i < KEYPATCH_KEYS; i++) held_note[i] = KP_NOTE_NONE;
+    batch_len = 0;
+    tusb_init();
+    printf("[MIDI] USB MIDI device up, channel %d\n", USB_MIDI_CHANNEL + 1);
+}
+
+bool usb_midi_note(uint8_t note, uint8_t velocity, bool on) {
+    if (note > 127) return false;
+    if ((size_t)batch_len + 3 > sizeof(batch)) usb_midi_flush();
+
+    batch[batch_len++] = (uint8_t)((on ? 0x90 : 0x80) | USB_MIDI_CHANNEL);
+    batch[batch_len++] = note;
+    batch[batch_len++] = velocity & 0x7F;
+    return true;
+}
+
+bool usb_midi_key_event(int idx, bool pressed) {
+    if ((unsigned)idx >= KEYPATCH_KEYS) return false;
+
+    if (pressed) {
+        const key_patch_t *p = keypatch_get(idx);
+        if (p->note == KP_NOTE_NONE) return false;
+        held_note[idx] = p->note;
+        return usb_midi_note(p->note, USB_MIDI_VELOCITY, true);
+    }
+
+    uint8_t note = held_note[idx];
+    if (note == KP_NOTE_NONE) return false;
+    held_note[idx] = KP_NOTE_NONE;
+    return usb_midi_note(note, 0, false);
+}
+
+void usb_midi_flush(void) {
+    if (!batch_len) return;
+
+    // One stream write = one flush = one bulk transfer for the whole batch.
+    // Nothing is queued while unmounted so a host plugging in later does
+    // not get a burst of stale notes.
+    if (tud_midi_mounted()) {
+        tud_midi_stream_write(0, batch, batch_len);
+    }
+    batch_len = 0;
+}
+
+// SysEx reassembly: USB-MIDI splits a message over 3-byte packets
+static uint8_t sysex[16];
+static uint8_t sysex_len;
+static bool    sysex_overflow;
+
+// Flash work is too slow for the RX loop; it runs after it
+static enum { FLASH_IDLE, FLASH_SAVE, FLASH_LOAD } flash_request;
+
+static void handle_sysex(const uint8_t *msg, uint8_t len) {
+    // msg excludes F0/F7
+    if (len < 2 || msg[0] != USB_MIDI_SYSEX_ID) return;
+
+    switch (msg[1]) {
+    case USB_MIDI_SYSEX_SET_KEY: {
+        if (len != 9) return;
+        const key_patch_t *cur = keypatch_get_bank(msg[2], msg[3]);
+        if (!cur) return;
+        key_patch_t p = *cur;            // keeps the label
+        p.r     = (uint8_t)(msg[4] << 1);
+        p.g     = (uint8_t)(msg[5] << 1);
+        p.b     = (uint8_t)(msg[6] << 1);
+        p.note  = msg[7];
+        p.flags = msg[8];
+        if (keypatch_set(msg[2], msg[3], &p)) {
+            printf("[MIDI] SysEx: bank %u key %u patched\n", msg[2], msg[3]);
+        }
+        break;
+    }
+    case USB_MIDI_SYSEX_BANK:
+        if (len == 3) neotrellis_select_bank(msg[2]);
+        break;
+    case USB_MIDI_SYSEX_SAVE:
+        flash_request = FLASH_SAVE;
+        break;
+    case USB_MIDI_SYSEX_LOAD:
+        flash_request = FLASH_LOAD;
+        break;
+    default:
+        break;
+    }
+}
+
+static void sysex_bytes(const uint8_t *b, uint8_t n) {
+    for (uint8_t i = 0; i < n; i++) {
+        if (b[i] == 0xF0) {
+            sysex_len = 0;
+            sysex_overflow = false;
+        } else if (b[i] == 0xF7) {
+            if (!sysex_overflow) handle_sysex(sysex, sysex_len);
+            sysex_len = 0;
+        } else if (sysex_len < sizeof(sysex)) {
+            sysex[sysex_len++] = b[i];
+        } else {
+            sysex_overflow = true;
+        }
+    }
+}
+
+static void handle_rx_packet(const uint8_t packet[4]) {
+    uint8_t cin    = packet[0] & 0x0F;    // code index number
+
+    switch (cin) {
+    case 0x4: sysex_bytes(&packet[1], 3); return;   // SysEx start/continue
+    case 0x5: sysex_bytes(&packet[1], 1); return;   // SysEx end, 1 byte
+    case 0x6: sysex_bytes(&packet[1], 2); return;   // SysEx end, 2 bytes
+    case 0x7: sysex_bytes(&packet[1], 3); return;   // SysEx end, 3 bytes
+    default: break;
+    }
+
+    uint8_t status = packet[1] & 0xF0;
+    uint8_t note   = packet[2] & 0x7F;
+    uint8_t vel    = packet[3] & 0x7F;
+
+    bool on;
+    if (cin == 0x9 && status == 0x90 && vel)           on = true;
+    else if ((cin == 0x8 && status == 0x80) ||
+             (cin == 0x9 && status == 0x90 && !vel))   on = false;
+    else return;
+
+    int idx = keypatch_find_note(note);
+    if (idx >= 0) {
+        neotrellis_key_set_latch(idx, on);
+        neotrellis_key_voice(idx, on);
+        neotrellis_key_led(idx, on);     // staged; uploaded from the main loop
+    } else if (on) {
+        play_note(note);
+    } else {
+        stop_note(note);
+    }
+}
+
+void usb_midi_task(void) {
+    tud_task();   // services the whole device, CDC included
+
+    uint8_t packet[4];
+    while (tud_midi_available() && tud_midi_packet_read(packet)) {
+        handle_rx_packet(packet);
+    }
+
+    if (flash_request == FLASH_SAVE) {
+        keypatch_save_flash();
+    } else if (flash_request == FLASH_LOAD && keypatch_load_flash()) {
+        neotrellis_select_bank(keypatch_active_bank());   // drops stale latches
+    }
+    flash_request = FLASH_IDLE;
+
+    usb_midi_flush();
+}
@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+"""Host side of the NeoTrellis framebuffer stream (see include/fbstream.h).
+
+Streams a dot moving over a static rainbow to the board's CDC port at a
+target rate, mixing full frames with dirty-region deltas (usually just
+the two pixels the dot left and entered), then asks the firmware for
+its received/shown/dropped/late counters.
+
+    pip install pyserial
+    ./tools/fbstream_host.py /dev/ttyACM0 --fps 30 --seconds 10
+
+With --dump the packets are written as hex to stdout instead of a port,
+which is handy for checking the encoder without hardware.
+"""
+import argparse
+import struct
+import sys
+import time
+
+SYNC = 0xA5
+FRAME, DELTA, RATE, STATS, STATS_REPLY = 0x01, 0x02, 0x03, 0x04, 0x84
+KEYS = 16
+FRAME_BYTES = KEYS * 3
+STAT_FIELDS = ("received", "shown", "dropped", "late", "bad_packets", "seq_gaps")
+
+
+def packet(ptype, seq, payload=b""):
+    body = bytes([ptype, seq & 0xFF, len(payload)]) + bytes(payload)
+    check = 0
+    for b in body:
+        check ^= b
+    return bytes([SYNC]) + body + bytes([check])
+
+
+def wheel(pos):
+    pos &= 0xFF
+    if pos < 85:
+        return 255 - pos * 3, pos * 3, 0
+    if pos < 170:
+        pos -= 85
+        return 0, 255 - pos * 3, pos * 3
+    pos -= 170
+    return pos * 3, 0, 255 - pos * 3
+
+
+def rainbow_frame(scale=8):
+    out = bytearray()
+    for i in range(KEYS):
+        r, g, b = wheel(i * 16)
+        out += bytes((g // scale, r // scale, b // scale))   # GRB wire order
+    return bytes(out)
+
+
+def dot_frame(step, background, level=0x40):
+    """Background with one white key, one key further along every frame."""
+    out = bytearray(background)
+    k = step % KEYS
+    out[3 * k:3 * k + 3] = bytes((level, level, level))
+    return bytes(out)
+
+
+def dirty_region(old, new):
+    """Smallest [start, end) byte span that differs, or None."""
+    diff = [i for i in range(FRAME_BYTES) if old[i] != new[i]]
+    if not diff:
+        return None
+    return diff[0], diff[-1] + 1
+
+
+class HexSink:
+    def write(self, data):
+        sys.stdout.write(data.hex(" ") + "\n")
+
+    def read(self, n):
+        return b""
+
+    def flush(self):
+        pass
+
+
+def read_stats(port, timeout=1.0):
+    deadline = time.monotonic() + timeout
+    buf = bytearray()
+    want = 4 + 4 * len(STAT_FIELDS) + 1
+    while time.monotonic() < deadline:
+        buf += port.read(want)
+        start = buf.find(bytes([SYNC, STATS_REPLY]))
+        if start >= 0 and len(buf) - start >= want:
+            pkt = buf[start:start + want]
+            payload = pkt[4:-1]
+            return dict(zip(STAT_FIELDS, struct.unpack("<%dI" % len(STAT_FIELDS), payload)))
+    return None
+
+
+def int_range(lo, hi=None):
+    """argparse type: an int in [lo, hi] (no upper bound if hi is None)."""
+    def parse(text):
+        v = int(text)
+        if v < lo or (hi is not None and v > hi):
+            bound = "%d..%d" % (lo, hi) if hi is not None else ">= %d" % lo
+            raise argparse.ArgumentTypeError("%s is out of range (%s)" % (text, bound))
+        return v
+    return parse
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("port", nargs="?", help="CDC serial port, e.g. /dev/ttyACM0")
+    ap.add_argument("--fps", type=int_range(1, 255), default=30, help="target frame rate (1..255)")
+    ap.add_argument("--seconds", type=float, default=5.0)
+    ap.add_argument("--full-every", type=int_range(1), default=10,
+                    help="send a full frame every N frames, deltas otherwise (1 = always full)")
+    ap.add_argument("--dump", action="store_true", help="print packets as hex, no port")
+    args = ap.parse_args()
+
+    if args.dump:
+        port = HexSink()
+    else:
+        if not args.port:
+            ap.error("port is required unless --dump is given")
+        import serial
+        port = serial.Serial(args.port, timeout=0.05)
+
+    seq = 0
+    fps = args.fps   # already 1..255, the same value the RATE packet carries
+    port.write(packet(RATE, seq, bytes([fps])))
+    seq += 1
+
+    period = 1.0 / fps
+    n_frames = int(args.seconds * fps)
+    prev = None
+    sent_bytes = 0
+    t_next = time.monotonic()
+
+    background = rainbow_frame()
+    n_delta = 0
+    for step in range(n_frames):
+        frame = dot_frame(step, background)
+        span = dirty_region(prev, frame) if prev is not None else None
+        if prev is None or step % args.full_every == 0 or span is None:
+            pkt = packet(FRAME, seq, frame)
+        else:
+            start, end = span
+            pkt = packet(DELTA, seq, bytes([start]) + frame[start:end])
+            n_delta += 1
+        port.write(pkt)
+        sent_bytes += len(pkt)
+        seq += 1
+        prev = frame
+
+        t_next += period
+        delay = t_next - time.monotonic()
+        if delay > 0 and not args.dump:
+            time.sleep(delay)
+
+    port.write(packet(STATS, seq))
+    port.flush()
+    print("sent %d frames (%d deltas), %d bytes (%.1f B/frame)"
+          % (n_frames, n_delta, sent_bytes, sent_bytes / max(n_frames, 1)), file=sys.stderr)
+
+    if not args.dump:
+        stats = read_stats(port)
+        if stats is None:
+            print("no stats reply", file=sys.stderr)
+            return 1
+        for k in STAT_FIELDS:
+            print("%-12s %d" % (k, stats[k]))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,293 @@
+// Host-side replay of a seesaw bus trace (see include/i2c_trace.h).
+//
+// Every record of a captured trace is pushed back through the real
+// src/seesaw.c against a simulated NeoTrellis, on a virtual clock that
+// charges each transfer its I2C bit time. The report compares the
+// recorded cost of each (dir, module, reg) group with the simulated one;
+// given a second trace it compares the two captures instead.
+//
+// Build (from the repo root):
+//   cc -O2 -Itools/i2c_replay/stub -Iinclude -o i2c_replay tools/i2c_replay/replay.c src/seesaw.c src/i2c_trace.c
+//
+// Usage:
+//   i2c_replay [--baud HZ] [--stretch US] [--emit] trace.csv
+//   i2c_replay before.csv after.csv
+//
+// --emit prints the simulated trace as CSV on stdout (report goes to
+// stderr), so a replay can itself be diffed against the capture.
+
+#include "seesaw.h"
+#include "neotrellis.h"
+#include "i2c_trace.h"
+#include "pico/stdlib.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_RECORDS  65536
+#define MAX_GROUPS   64
+
+// ---------------------------------------------------------------------------
+// Virtual clock and bus model
+
+static uint64_t sim_us;
+static uint32_t sim_baud = 100000;
+static uint32_t sim_stretch_us;       // extra device latency per transfer
+
+uint32_t time_us_32(void) { return (uint32_t)sim_us; }
+uint64_t time_us_64(void) { return sim_us; }
+void sleep_us(uint64_t us) { sim_us += us; }
+void sleep_ms(uint32_t ms) { sim_us += (uint64_t)ms * 1000u; }
+
+static struct i2c_inst { int id; } bus0 = { 0 }, bus1 = { 1 };
+i2c_inst_t *i2c0 = &bus0;
+i2c_inst_t *i2c1 = &bus1;
+
+unsigned i2c_init(i2c_inst_t *i2c, unsigned baudrate) {
+    (void)i2c;
+    return i2c_set_baudrate(i2c, baudrate);
+}
+
+unsigned i2c_set_baudrate(i2c_inst_t *i2c, unsigned baudrate) {
+    (void)i2c;
+    (void)baudrate;             // the model runs at --baud, not the firmware's value
+    return sim_baud;
+}
+
+static void charge_transfer(size_t bytes) {
+    // START + address byte + data bytes (9 clocks each, with ACK) + STOP
+    uint64_t bits = 1 + 9 * (1 + bytes) + 1;
+    sim_us += (bits * 1000000u + sim_baud - 1) / sim_baud + sim_stretch_us;
+}
+
+// ---------------------------------------------------------------------------
+// Simulated seesaw: enough state to answer the reads the driver issues
+
+static bool    dev_nak_next;          // replaying a transfer that failed
+static uint8_t dev_module, dev_reg;
+
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop) {
+    (void)i2c; (void)nostop;
+    charge_transfer(len);
+    if (dev_nak_next || addr != NEOTRELLIS_ADDR) {
+        dev_nak_next = false;
+        return -2;              // PICO_ERROR_GENERIC
+    }
+    if (len >= 2) {
+        dev_module = src[0];
+        dev_reg    = src[1];
+    }
+    return (int)len;
+}
+
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop) {
+    (void)i2c; (void)nostop;
+    charge_transfer(len);
+    if (dev_nak_next || addr != NEOTRELLIS_ADDR) {
+        dev_nak_next = false;
+        return -2;
+    }
+
+    memset(dst, 0, len);
+    if (dev_module == SEESAW_STATUS_BASE && dev_reg == SEESAW_STATUS_HW_ID && len) {
+        dst[0] = 0x55;
+    } else if (dev_module == SEESAW_STATUS_BASE && dev_reg == SEESAW_STATUS_VERSION) {
+        static const uint8_t ver[4] = { 0x0F, 0xA1, 0x00, 0x00 };
+        memcpy(dst, ver, len < 4 ? len : 4);
+    } else if (dev_module == SEESAW_KEYPAD_BASE && dev_reg == KEYPAD_FIFO) {
+        memset(dst, 0xFF, len);  // empty FIFO
+    }
+    return (int)len;
+}
+
+// ---------------------------------------------------------------------------
+// Trace loading
+
+typedef struct {
+    i2c_trace_rec_t rec;
+    uint32_t        sim_dur_us;
+    bool            sim_ok;
+} replay_rec_t;
+
+static int load_trace(const char *path, replay_rec_t *out, int max) {
+    FILE *f = fopen(path, "r");
+    if (!f) { perror(path); return -1; }
+
+    char line[256];
+    int n = 0;
+    while (fgets(line, sizeof(line), f) && n < max) {
+        unsigned long t;
+        unsigned dur, addr, module, reg, len, ok, digest;
+        char dir;
+        // Other console output may be interleaved with the dump; skip it
+        if (sscanf(line, "%lu,%u,%c,%x,%x,%x,%u,%u,%x",
+                   &t, &dur, &dir, &addr, &module, &reg, &len, &ok, &digest) != 9) {
+            continue;
+        }
+        i2c_trace_rec_t *r = &out[n++].rec;
+        r->t_us   = (uint32_t)t;
+        r->dur_us = (uint16_t)dur;
+        r->dir    = (uint8_t)dir;
+        r->addr   = (uint8_t)addr;
+        r->module = (uint8_t)module;
+        r->reg    = (uint8_t)reg;
+        r->len    = (uint16_t)len;
+        r->ok     = (uint8_t)ok;
+        r->digest = (uint16_t)digest;
+    }
+    fclose(f);
+    return n;
+}
+
+// ---------------------------------------------------------------------------
+// Per (dir, module, reg) cost summary
+
+typedef struct {
+    uint8_t  dir, module, reg;
+    uint32_t count[2];
+    uint64_t bytes[2];
+    uint64_t us[2];
+} group_t;
+
+static group_t groups[MAX_GROUPS];
+static int     n_groups;
+
+static group_t *group_for(const i2c_trace_rec_t *r) {
+    for (int i = 0; i < n_groups; i++) {
+        group_t *g = &groups[i];
+        if (g->dir == r->dir && g->module == r->module && g->reg == r->reg) return g;
+    }
+    if (n_groups == MAX_GROUPS) return NULL;
+    group_t *g = &groups[n_groups++];
+    memset(g, 0, sizeof(*g));
+    g->dir = r->dir; g->module = r->module; g->reg = r->reg;
+    return g;
+}
+
+static void account(int column, const i2c_trace_rec_t *r, uint32_t dur_us) {
+    group_t *g = group_for(r);
+    if (!g) return;
+    g->count[column]++;
+    g->bytes[column] += r->len;
+    g->us[column]    += dur_us;
+}
+
+static void print_groups(const char *a, const char *b) {
+    uint64_t tot[2] = { 0, 0 };
+    fprintf(stderr, "%-3s %-6s %-5s | %8s %10s %8s | %8s %10s %8s\n",
+            "dir", "module", "reg", "count", a, "avg", "count", b, "avg");
+    for (int i = 0; i < n_groups; i++) {
+        const group_t *g = &groups[i];
+        fprintf(stderr, "%-3c 0x%02X   0x%02X  | %8u %10llu %8.1f | %8u %10llu %8.1f\n",
+                g->dir, g->module, g->reg,
+                g->count[0], (unsigned long long)g->us[0],
+                g->count[0] ? (double)g->us[0] / g->count[0] : 0.0,
+                g->count[1], (unsigned long long)g->us[1],
+                g->count[1] ? (double)g->us[1] / g->count[1] : 0.0);
+        tot[0] += g->us[0];
+        tot[1] += g->us[1];
+    }
+    fprintf(stderr, "total bus time: %s %llu us, %s %llu us (%+.1f%%)\n",
+            a, (unsigned long long)tot[0], b, (unsigned long long)tot[1],
+            tot[0] ? 100.0 * ((double)tot[1] - (double)tot[0]) / (double)tot[0] : 0.0);
+}
+
+// ---------------------------------------------------------------------------
+
+static void replay_one(replay_rec_t *rr) {
+    static uint8_t payload[2 + 65535];
+    const i2c_trace_rec_t *r = &rr->rec;
+
+    // Write payloads are only known by digest; the stand-in ignores them
+    memset(payload, 0, r->len);
+    dev_nak_next = !r->ok;
+
+    uint64_t t0 = sim_us;
+    switch (r->dir) {
+    case I2C_TRACE_WRITE:
+        rr->sim_ok = seesaw_write(r->addr, r->module, r->reg, payload, r->len);
+        break;
+    case I2C_TRACE_WRITE_BUF:
+        rr->sim_ok = r->len <= 30 &&
+                     seesaw_write_buf(r->addr, r->module, r->reg, payload, r->len);
+        break;
+    case I2C_TRACE_READ:
+        rr->sim_ok = seesaw_read(r->addr, r->module, r->reg, payload, r->len);
+        break;
+    default:
+        rr->sim_ok = false;
+        break;
+    }
+    dev_nak_next = false;
+    rr->sim_dur_us = (uint32_t)(sim_us - t0);
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: i2c_replay [--baud HZ] [--stretch US] [--emit] trace.csv\n"
+            "       i2c_replay before.csv after.csv\n");
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    const char *files[2] = { NULL, NULL };
+    int n_files = 0;
+    bool emit = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--baud") && i + 1 < argc)         sim_baud = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--stretch") && i + 1 < argc) sim_stretch_us = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--emit"))                    emit = true;
+        else if (argv[i][0] == '-' || n_files == 2)             usage();
+        else                                                    files[n_files++] = argv[i];
+    }
+    if (n_files == 0 || sim_baud == 0) usage();
+
+    static replay_rec_t recs[2][MAX_RECORDS];
+    int n[2] = { 0, 0 };
+    for (int f = 0; f < n_files; f++) {
+        n[f] = load_trace(files[f], recs[f], MAX_RECORDS);
+        if (n[f] < 0) return 1;
+        fprintf(stderr, "%s: %d transactions\n", files[f], n[f]);
+    }
+
+    if (n_files == 2) {
+        for (int f = 0; f < 2; f++) {
+            for (int i = 0; i < n[f]; i++) account(f, &recs[f][i].rec, recs[f][i].rec.dur_us);
+        }
+        print_groups("before_us", "after_us");
+        return 0;
+    }
+
+    // Replay on the original schedule: each transfer starts at its recorded
+    // offset, or as soon as the simulated bus frees up if it is running late.
+    seesaw_bus_init(sim_baud);
+    i2c_trace_clear();
+    i2c_trace_enable(emit);
+
+    uint32_t t_first = n[0] ? recs[0][0].rec.t_us : 0;
+    int result_mismatch = 0, late = 0;
+    for (int i = 0; i < n[0]; i++) {
+        replay_rec_t *rr = &recs[0][i];
+        uint64_t due = (uint32_t)(rr->rec.t_us - t_first);
+        if (sim_us < due) sim_us = due;
+        else if (sim_us > due) late++;
+
+        replay_one(rr);
+        if (rr->sim_ok != (bool)rr->rec.ok) result_mismatch++;
+        account(0, &rr->rec, rr->rec.dur_us);
+        account(1, &rr->rec, rr->sim_dur_us);
+    }
+
+    print_groups("recorded_us", "sim_us");
+    fprintf(stderr, "bus model %lu Hz, stretch %lu us: %d transfers started late, %d result mismatches\n",
+            (unsigned long)sim_baud, (unsigned long)sim_stretch_us, late, result_mismatch);
+
+    if (emit) {
+        if (n[0] > I2C_TRACE_DEPTH) {
+            fprintf(stderr, "note: only the last %d simulated records are kept\n", I2C_TRACE_DEPTH);
+        }
+        i2c_trace_dump();
+    }
+    return result_mismatch ? 1 : 0;
+}
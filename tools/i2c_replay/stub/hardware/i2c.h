@@ -0,0 +1,14 @@
+#pragma once
+// Host stand-in for hardware/i2c.h, backed by the simulated seesaw in replay.c
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct i2c_inst i2c_inst_t;
+extern i2c_inst_t *i2c0;
+extern i2c_inst_t *i2c1;
+
+unsigned i2c_init(i2c_inst_t *i2c, unsigned baudrate);
+unsigned i2c_set_baudrate(i2c_inst_t *i2c, unsigned baudrate);
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop);
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop);
@@ -0,0 +1,19 @@
+#pragma once
+// Host stand-in for the bits of pico/stdlib.h that seesaw.c uses.
+// Time is virtual and only advances through the simulated bus.
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "hardware/i2c.h"
+
+typedef unsigned int uint;
+
+enum { GPIO_FUNC_I2C = 3 };
+
+static inline void gpio_set_function(uint gpio, int fn) { (void)gpio; (void)fn; }
+static inline void gpio_pull_up(uint gpio) { (void)gpio; }
+
+uint32_t time_us_32(void);
+uint64_t time_us_64(void);
+void     sleep_us(uint64_t us);
+void     sleep_ms(uint32_t ms);